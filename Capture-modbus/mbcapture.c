@@ -0,0 +1,654 @@
+/*************************************************************************
+ *	file : mbcapture.c
+ *	binary capture of modbus traffic and replay from the capture file
+ *	Author : agent
+ *	Date : October 2026
+ *
+ *	Needs a hosted platform : stdio for capture, mmap (POSIX) or a file
+ *	mapping (WIN32) for replay and a nanosecond monotonic clock.
+ *
+ *************************************************************************
+ */
+#ifndef WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "mbcapture.h"
+#include "stdio.h"
+#include "string.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#ifdef MBREPLAY_ETHERNET
+#include "tcp_modbus.h"
+#endif
+
+#ifdef TCP_MODBUS_CAPTURE
+extern int write_ethernet(uint8_t *buff, uint32_t numBytestoWrite);
+extern int read_ethernet(uint8_t *buf, uint32_t numBytestoRead);
+#endif
+
+/*
+ * bus functions of one port, the originals while capturing and the
+ * port wrappers installed by MBCAP_attach / MBREPLAY_attach
+ */
+typedef struct {
+	uint32_t(*COM_read)(uint8_t* pBuf, uint16_t BytesToRead, uint16_t timout);
+	uint32_t(*COM_write)(uint8_t* pBuff, uint16_t BytesToWrite, uint16_t timout);
+	uint32_t(*NET_read)(void* net, uint8_t* pBuf, uint16_t BytesToRead, uint16_t timout);
+	uint32_t(*NET_write)(void* net, uint8_t* pBuff, uint16_t BytesToWrite, uint16_t timout);
+} MBCAP_PortTypeDef;
+
+static struct {
+	FILE* file;
+	MODBUS_HandleTypeDef* bus[MBCAP_MAX_PORTS];     // 0 for a free port
+	MBCAP_PortTypeDef saved[MBCAP_MAX_PORTS];
+} capture;
+
+/*
+ * replay position of one port (or of the TCP channel), every port walks the
+ * file on its own so the ports can be polled in any order
+ */
+typedef struct {
+	size_t pos;             // offset of the next record to look at
+	size_t session;         // offset of the last session record passed
+	const uint8_t* rx;      // read record being served
+	uint16_t rx_len;
+	uint16_t rx_used;
+	uint16_t tcp_id_delta;  // live minus recorded MBAP transaction id
+	uint16_t tcp_pos;       // offset inside the MBAP response being served
+	uint16_t tcp_len;       // length of that response, 0 until its header is read
+	uint8_t tcp_header[6];
+} MBREPLAY_CursorTypeDef;
+
+static struct {
+	const uint8_t* base;    // mapped file
+	size_t size;
+	uint8_t record_header;  // record header size of the file version
+	uint8_t speed;
+	uint8_t paced;          // first_ts / start_ns are valid
+	size_t anchor;          // session record first_ts / start_ns belong to
+	uint64_t first_ts;
+	uint64_t start_ns;
+	MODBUS_HandleTypeDef* bus[MBCAP_MAX_PORTS];
+	MBREPLAY_CursorTypeDef port[MBCAP_MAX_PORTS];
+	MBREPLAY_CursorTypeDef tcp;
+	uint8_t tcp_used;
+#ifdef WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+} replay;
+
+/*
+ *	@brief: monotonic time in nanoseconds
+ */
+static uint64_t mbcap_now_ns(void) {
+#ifdef WIN32
+	LARGE_INTEGER count, freq;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return (uint64_t)(count.QuadPart / freq.QuadPart) * 1000000000ull +
+		(uint64_t)(count.QuadPart % freq.QuadPart) * 1000000000ull / (uint64_t)freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/*
+ *	@brief: sleep until the monotonic clock reaches a point in time
+ *	@param: time in nanoseconds
+ */
+static void mbcap_sleep_until(uint64_t t) {
+	uint64_t now = mbcap_now_ns();
+	while (now < t) {
+#ifdef WIN32
+		Sleep((DWORD)((t - now) / 1000000));
+#else
+		struct timespec ts;
+		ts.tv_sec = (time_t)((t - now) / 1000000000ull);
+		ts.tv_nsec = (long)((t - now) % 1000000000ull);
+		nanosleep(&ts, 0);
+#endif
+		now = mbcap_now_ns();
+	}
+}
+
+static void mbcap_put_u16(uint8_t* p, uint16_t v) {
+	p[0] = (uint8_t)(v & 0x00ff);
+	p[1] = (uint8_t)(v >> 8);
+}
+
+static uint16_t mbcap_get_u16(const uint8_t* p) {
+	return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static void mbcap_put_u64(uint8_t* p, uint64_t v) {
+	for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint64_t mbcap_get_u64(const uint8_t* p) {
+	uint64_t v = 0;
+	for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+	return v;
+}
+
+/*
+ *	@brief: append one record to the capture file
+ *	@param: MBCAP_CHANNEL_xxx
+ *	@param: port of the handle, 0 for the TCP channel
+ *	@param: MBCAP_DIR_xxx
+ *	@param: frame data
+ *	@param: number of bytes
+ */
+static void mbcap_record(uint8_t channel, uint8_t port, uint8_t direction, const uint8_t* data, uint32_t len) {
+	uint8_t header[MBCAP_RECORD_HEADER_SIZE];
+	if (capture.file == 0 || (len == 0 && channel != MBCAP_CHANNEL_SESSION)) return;
+	if (len > 0xffff) len = 0xffff;
+	mbcap_put_u64(header, mbcap_now_ns());
+	header[8] = channel;
+	header[9] = direction;
+	mbcap_put_u16(&header[10], (uint16_t)len);
+	header[12] = port;
+	fwrite(header, 1, sizeof(header), capture.file);
+	if (len) fwrite(data, 1, len, capture.file);
+}
+
+/*
+*	@brief: open a capture file for appending, the header is written to new files
+*			and every open starts a session record
+*	@param: file name
+*	@return: 0 on success, -1 also for an existing file of an other version
+*/
+int MBCAP_open(const char* file_name) {
+	uint8_t header[MBCAP_HEADER_SIZE];
+	if (capture.file) return -1;
+	capture.file = fopen(file_name, "a+b");
+	if (capture.file == 0) return -1;
+	fseek(capture.file, 0, SEEK_END);
+	if (ftell(capture.file) == 0) {
+		memcpy(header, "MBCP", 4);
+		mbcap_put_u16(&header[4], MBCAP_VERSION);
+		mbcap_put_u16(&header[6], 0);
+		fwrite(header, 1, sizeof(header), capture.file);
+	}
+	else {
+		fseek(capture.file, 0, SEEK_SET);
+		if (fread(header, 1, sizeof(header), capture.file) != sizeof(header) ||
+			memcmp(header, "MBCP", 4) != 0 || mbcap_get_u16(&header[4]) != MBCAP_VERSION) {
+			fclose(capture.file);
+			capture.file = 0;
+			return -1;
+		}
+		fseek(capture.file, 0, SEEK_END); // writes go to the end anyway, a seek is needed between a read and a write
+	}
+	mbcap_record(MBCAP_CHANNEL_SESSION, 0, MBCAP_DIR_WRITE, 0, 0);
+	return 0;
+}
+
+/*
+*	@brief: flush and close the capture file
+*	@return: 0 on success
+*/
+int MBCAP_close(void) {
+	int ret_val;
+	if (capture.file == 0) return -1;
+	ret_val = fclose(capture.file);
+	capture.file = 0;
+	return ret_val == 0 ? 0 : -1;
+}
+
+static uint32_t mbcap_COM_write(uint8_t port, uint8_t* pBuff, uint16_t BytesToWrite, uint16_t timout) {
+	uint32_t n = capture.saved[port].COM_write(pBuff, BytesToWrite, timout);
+	mbcap_record(MBCAP_CHANNEL_RTU, port, MBCAP_DIR_WRITE, pBuff, n);
+	return n;
+}
+
+static uint32_t mbcap_COM_read(uint8_t port, uint8_t* pBuf, uint16_t BytesToRead, uint16_t timout) {
+	uint32_t n = capture.saved[port].COM_read(pBuf, BytesToRead, timout);
+	mbcap_record(MBCAP_CHANNEL_RTU, port, MBCAP_DIR_READ, pBuf, n);
+	return n;
+}
+
+static uint32_t mbcap_NET_write(uint8_t port, void* net, uint8_t* pBuff, uint16_t BytesToWrite, uint16_t timout) {
+	uint32_t n = capture.saved[port].NET_write(net, pBuff, BytesToWrite, timout);
+	mbcap_record(MBCAP_CHANNEL_RTU, port, MBCAP_DIR_WRITE, pBuff, n);
+	return n;
+}
+
+static uint32_t mbcap_NET_read(uint8_t port, void* net, uint8_t* pBuf, uint16_t BytesToRead, uint16_t timout) {
+	uint32_t n = capture.saved[port].NET_read(net, pBuf, BytesToRead, timout);
+	mbcap_record(MBCAP_CHANNEL_RTU, port, MBCAP_DIR_READ, pBuf, n);
+	return n;
+}
+
+/*
+ * The bus functions carry no context, so every port has its own set of
+ * wrappers that only passes its number on.
+ */
+#if MBCAP_MAX_PORTS != 4
+#error "one MBCAP_PORT_WRAPPERS / MBREPLAY_PORT_WRAPPERS line per port is needed"
+#endif
+
+#define MBCAP_PORT_WRAPPERS(p) \
+static uint32_t mbcap_COM_read_##p(uint8_t* pBuf, uint16_t BytesToRead, uint16_t timout) { return mbcap_COM_read(p, pBuf, BytesToRead, timout); } \
+static uint32_t mbcap_COM_write_##p(uint8_t* pBuff, uint16_t BytesToWrite, uint16_t timout) { return mbcap_COM_write(p, pBuff, BytesToWrite, timout); } \
+static uint32_t mbcap_NET_read_##p(void* net, uint8_t* pBuf, uint16_t BytesToRead, uint16_t timout) { return mbcap_NET_read(p, net, pBuf, BytesToRead, timout); } \
+static uint32_t mbcap_NET_write_##p(void* net, uint8_t* pBuff, uint16_t BytesToWrite, uint16_t timout) { return mbcap_NET_write(p, net, pBuff, BytesToWrite, timout); }
+
+MBCAP_PORT_WRAPPERS(0)
+MBCAP_PORT_WRAPPERS(1)
+MBCAP_PORT_WRAPPERS(2)
+MBCAP_PORT_WRAPPERS(3)
+
+#define MBCAP_PORT(p) { mbcap_COM_read_##p, mbcap_COM_write_##p, mbcap_NET_read_##p, mbcap_NET_write_##p }
+
+static const MBCAP_PortTypeDef mbcap_ports[MBCAP_MAX_PORTS] = {
+	MBCAP_PORT(0), MBCAP_PORT(1), MBCAP_PORT(2), MBCAP_PORT(3)
+};
+
+/*
+ *	@brief: give a handle the lowest free port
+ *	@param: port table of capture or replay
+ *	@param: handle to add
+ *	@return: port number, -1 if the handle is already in the table or the table is full
+ */
+static int mbcap_port_take(MODBUS_HandleTypeDef** table, MODBUS_HandleTypeDef* bus) {
+	int port = -1;
+	for (int i = 0; i < MBCAP_MAX_PORTS; i++) {
+		if (table[i] == bus) return -1;
+		if (table[i] == 0 && port < 0) port = i;
+	}
+	if (port >= 0) table[port] = bus;
+	return port;
+}
+
+/*
+ *	@brief: swap the bus functions a handle uses, NET_xxx once MODBUS_NET_attach was called
+ *	@param: handle
+ *	@param: functions to install
+ *	@param: receives the functions that were installed, can be 0
+ */
+static void mbcap_port_install(MODBUS_HandleTypeDef* bus, const MBCAP_PortTypeDef* port, MBCAP_PortTypeDef* saved) {
+	if (saved) {
+		saved->COM_read = bus->COM_read;
+		saved->COM_write = bus->COM_write;
+		saved->NET_read = bus->NET_read;
+		saved->NET_write = bus->NET_write;
+	}
+	if (bus->net) {
+		bus->NET_read = port->NET_read;
+		bus->NET_write = port->NET_write;
+	}
+	else {
+		bus->COM_read = port->COM_read;
+		bus->COM_write = port->COM_write;
+	}
+}
+
+/*
+*	@brief: start recording the traffic of an RTU handle, COM port or socket (MODBUS_NET_attach).
+*			up to MBCAP_MAX_PORTS handles, numbered in the order they are attached
+*	@param: pointer to handle that controls the communication bus( COM port)
+*	@return: 0 on success
+*/
+int MBCAP_attach(MODBUS_HandleTypeDef* bus) {
+	int port = mbcap_port_take(capture.bus, bus);
+	if (port < 0) return -1;
+	mbcap_port_install(bus, &mbcap_ports[port], &capture.saved[port]);
+	return 0;
+}
+
+/*
+*	@brief: give an RTU handle its own COM / NET functions back, its port number is free again
+*	@param: pointer to handle that controls the communication bus( COM port)
+*	@return: 0 on success
+*/
+int MBCAP_detach(MODBUS_HandleTypeDef* bus) {
+	for (int i = 0; i < MBCAP_MAX_PORTS; i++) {
+		if (capture.bus[i] != bus) continue;
+		if (bus->NET_read == mbcap_ports[i].NET_read) {
+			bus->NET_read = capture.saved[i].NET_read;
+			bus->NET_write = capture.saved[i].NET_write;
+		}
+		if (bus->COM_read == mbcap_ports[i].COM_read) {
+			bus->COM_read = capture.saved[i].COM_read;
+			bus->COM_write = capture.saved[i].COM_write;
+		}
+		capture.bus[i] = 0;
+		memset(&capture.saved[i], 0, sizeof(MBCAP_PortTypeDef));
+		return 0;
+	}
+	return -1;
+}
+
+#ifdef TCP_MODBUS_CAPTURE
+int MBCAP_write_ethernet(uint8_t *buff, uint32_t numBytestoWrite) {
+	int n = write_ethernet(buff, numBytestoWrite);
+	if (n > 0) mbcap_record(MBCAP_CHANNEL_TCP, 0, MBCAP_DIR_WRITE, buff, (uint32_t)n);
+	return n;
+}
+
+int MBCAP_read_ethernet(uint8_t *buf, uint32_t numBytestoRead) {
+	int n = read_ethernet(buf, numBytestoRead);
+	if (n > 0) mbcap_record(MBCAP_CHANNEL_TCP, 0, MBCAP_DIR_READ, buf, (uint32_t)n);
+	return n;
+}
+#endif
+
+
+/*
+*	@brief: map a capture file for replay, version 1 files are replayed as port 0
+*	@param: file name
+*	@param: MBREPLAY_SPEED_ORIGINAL or MBREPLAY_SPEED_MAX
+*	@return: 0 on success
+*/
+int MBREPLAY_open(const char* file_name, uint8_t speed) {
+	if (replay.base) return -1;
+	memset(&replay, 0, sizeof(replay));
+#ifdef WIN32
+	LARGE_INTEGER size;
+	replay.file = CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (replay.file == INVALID_HANDLE_VALUE) return -1;
+	if (!GetFileSizeEx(replay.file, &size) || size.QuadPart < MBCAP_HEADER_SIZE) {
+		CloseHandle(replay.file);
+		return -1;
+	}
+	replay.mapping = CreateFileMappingA(replay.file, 0, PAGE_READONLY, 0, 0, 0);
+	if (replay.mapping == 0) {
+		CloseHandle(replay.file);
+		return -1;
+	}
+	replay.base = (const uint8_t*)MapViewOfFile(replay.mapping, FILE_MAP_READ, 0, 0, 0);
+	if (replay.base == 0) {
+		CloseHandle(replay.mapping);
+		CloseHandle(replay.file);
+		return -1;
+	}
+	replay.size = (size_t)size.QuadPart;
+#else
+	struct stat st;
+	void* base;
+	int fd = open(file_name, O_RDONLY);
+	if (fd < 0) return -1;
+	if (fstat(fd, &st) != 0 || st.st_size < MBCAP_HEADER_SIZE) {
+		close(fd);
+		return -1;
+	}
+	base = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // the mapping stays valid
+	if (base == MAP_FAILED) return -1;
+	replay.base = (const uint8_t*)base;
+	replay.size = (size_t)st.st_size;
+#endif
+	if (memcmp(replay.base, "MBCP", 4) != 0) {
+		MBREPLAY_close();
+		return -1;
+	}
+	switch (mbcap_get_u16(&replay.base[4])) {
+	case 1:
+		replay.record_header = MBCAP_RECORD_HEADER_SIZE_V1; // every record on port 0
+		break;
+	case MBCAP_VERSION:
+		replay.record_header = MBCAP_RECORD_HEADER_SIZE;
+		break;
+	default:
+		MBREPLAY_close();
+		return -1;
+	}
+	for (int i = 0; i < MBCAP_MAX_PORTS; i++) replay.port[i].pos = MBCAP_HEADER_SIZE;
+	replay.tcp.pos = MBCAP_HEADER_SIZE;
+	replay.speed = speed;
+	return 0;
+}
+
+/*
+*	@brief: unmap the replay file
+*	@return: 0 on success
+*/
+int MBREPLAY_close(void) {
+	if (replay.base == 0) return -1;
+#ifdef WIN32
+	UnmapViewOfFile(replay.base);
+	CloseHandle(replay.mapping);
+	CloseHandle(replay.file);
+#else
+	munmap((void*)replay.base, replay.size);
+#endif
+	memset(&replay, 0, sizeof(replay));
+	return 0;
+}
+
+
+/*
+ *	@brief: record of the replay file at an offset
+ *	@return: pointer to the record header, 0 at the end or on a truncated record
+ */
+static const uint8_t* mbreplay_record(size_t pos) {
+	const uint8_t* rec;
+	if (pos + replay.record_header > replay.size) return 0;
+	rec = replay.base + pos;
+	if (pos + replay.record_header + mbcap_get_u16(&rec[10]) > replay.size) return 0;
+	return rec;
+}
+
+static uint8_t mbreplay_port(const uint8_t* rec) {
+	return replay.record_header > MBCAP_RECORD_HEADER_SIZE_V1 ? rec[12] : 0;
+}
+
+/*
+ *	@brief: look at the next record of a port without consuming it, the records
+ *			of the other ports are stepped over
+ *	@param: cursor of the port
+ *	@param: MBCAP_CHANNEL_xxx
+ *	@param: port number
+ *	@return: pointer to the record header, 0 at the end or on a truncated record
+ */
+static const uint8_t* mbreplay_peek(MBREPLAY_CursorTypeDef* cur, uint8_t channel, uint8_t port) {
+	const uint8_t* rec;
+	while ((rec = mbreplay_record(cur->pos)) != 0) {
+		if (rec[8] == channel && mbreplay_port(rec) == port) return rec;
+		if (rec[8] == MBCAP_CHANNEL_SESSION) {
+			cur->session = cur->pos;
+			if (replay.speed == MBREPLAY_SPEED_ORIGINAL && (!replay.paced || cur->pos > replay.anchor)) {
+				// the first port to reach a capture session restarts the clock
+				replay.anchor = cur->pos;
+				replay.first_ts = mbcap_get_u64(rec);
+				replay.start_ns = mbcap_now_ns();
+				replay.paced = 1;
+			}
+		}
+		cur->pos += replay.record_header + mbcap_get_u16(&rec[10]);
+	}
+	return 0;
+}
+
+/*
+ *	@brief: consume a record, waiting for its recorded time in original speed mode
+ *	@param: cursor of the port
+ *	@param: record returned by mbreplay_peek
+ */
+static void mbreplay_take(MBREPLAY_CursorTypeDef* cur, const uint8_t* rec) {
+	uint64_t ts = mbcap_get_u64(rec);
+	cur->pos += replay.record_header + mbcap_get_u16(&rec[10]);
+	if (replay.speed != MBREPLAY_SPEED_ORIGINAL) return;
+	if (!replay.paced) { // a version 1 file without session records
+		replay.anchor = cur->session;
+		replay.first_ts = ts;
+		replay.start_ns = mbcap_now_ns();
+		replay.paced = 1;
+	}
+	if (cur->session != replay.anchor || ts < replay.first_ts) return; // behind the session the clock runs for
+	mbcap_sleep_until(replay.start_ns + (ts - replay.first_ts));
+}
+
+/*
+*	@brief: check if every record of the attached ports, and of the TCP channel
+*			once it was used, has been consumed
+*	@return: 1 at the end of the file
+*/
+int MBREPLAY_end(void) {
+	if (replay.base == 0) return 1;
+	for (int i = 0; i < MBCAP_MAX_PORTS; i++) {
+		if (replay.bus[i] && mbreplay_peek(&replay.port[i], MBCAP_CHANNEL_RTU, (uint8_t)i)) return 0;
+	}
+	if (replay.tcp_used && mbreplay_peek(&replay.tcp, MBCAP_CHANNEL_TCP, 0)) return 0;
+	return 1;
+}
+
+/*
+ *	@brief: consume the next recorded write of a port
+ *	@param: cursor of the port
+ *	@param: MBCAP_CHANNEL_xxx
+ *	@param: port number
+ *	@param: bytes the library wants to write
+ *	@param: number of bytes the library wants to write
+ *	@return: number of bytes "written", 0 at the end of the file
+ */
+static uint32_t mbreplay_write(MBREPLAY_CursorTypeDef* cur, uint8_t channel, uint8_t port, const uint8_t* buf, uint32_t len) {
+	const uint8_t* rec;
+	cur->rx_used = cur->rx_len; // responses the library did not read are dropped
+	cur->tcp_pos = 0;
+	while ((rec = mbreplay_peek(cur, channel, port)) != 0) {
+		mbreplay_take(cur, rec);
+		if (rec[9] != MBCAP_DIR_WRITE) continue;
+		if (channel == MBCAP_CHANNEL_TCP && len >= 2 && mbcap_get_u16(&rec[10]) >= 2) {
+			// the transaction ids of this run differ from the recorded ones
+			uint16_t live = ((uint16_t)buf[0] << 8) | buf[1];
+			uint16_t recorded = ((uint16_t)rec[replay.record_header] << 8) | rec[replay.record_header + 1];
+			cur->tcp_id_delta = (uint16_t)(live - recorded);
+		}
+		return len;
+	}
+	return 0;
+}
+
+/*
+ *	@brief: follow the MBAP framing of served TCP bytes and move the transaction
+ *			id of every response by the same amount as the ids of the requests
+ *	@param: cursor of the TCP channel
+ *	@param: served byte, patched in place
+ *	@param: recorded byte that follows it, 0 if it is in an other record
+ */
+static void mbreplay_tcp_byte(MBREPLAY_CursorTypeDef* cur, uint8_t* b, const uint8_t* next) {
+	uint16_t id;
+	if (cur->tcp_pos < sizeof(cur->tcp_header)) cur->tcp_header[cur->tcp_pos] = *b;
+	if (cur->tcp_pos == 0) {
+		if (next) {
+			id = (uint16_t)((((uint16_t)*b << 8) | *next) + cur->tcp_id_delta);
+			*b = (uint8_t)(id >> 8);
+		}
+		else *b = (uint8_t)(*b + (cur->tcp_id_delta >> 8)); // low byte in the next record, carry unknown
+	}
+	else if (cur->tcp_pos == 1) {
+		*b = (uint8_t)(*b + (cur->tcp_id_delta & 0x00ff));
+	}
+	else if (cur->tcp_pos == 5) {
+		cur->tcp_len = 6 + (((uint16_t)cur->tcp_header[4] << 8) | cur->tcp_header[5]);
+	}
+	cur->tcp_pos++;
+	if (cur->tcp_pos >= 6 && cur->tcp_pos >= cur->tcp_len) {
+		cur->tcp_pos = 0;
+		cur->tcp_len = 0;
+	}
+}
+
+/*
+ *	@brief: serve a read from the recorded reads of a port, stops at its next write
+ *	@param: cursor of the port
+ *	@param: MBCAP_CHANNEL_xxx
+ *	@param: port number
+ *	@param: pointer to buffer array
+ *	@param: number of bytes to read
+ *	@return: number of bytes actualy read
+ */
+static uint32_t mbreplay_read(MBREPLAY_CursorTypeDef* cur, uint8_t channel, uint8_t port, uint8_t* buf, uint32_t len) {
+	const uint8_t* rec;
+	uint32_t n = 0;
+	while (n < len) {
+		if (cur->rx_used < cur->rx_len) {
+			uint32_t chunk = cur->rx_len - cur->rx_used;
+			if (chunk > len - n) chunk = len - n;
+			memcpy(buf + n, cur->rx + cur->rx_used, chunk);
+			if (channel == MBCAP_CHANNEL_TCP) {
+				for (uint32_t i = 0; i < chunk; i++) {
+					uint32_t at = cur->rx_used + i;
+					mbreplay_tcp_byte(cur, buf + n + i, at + 1 < cur->rx_len ? cur->rx + at + 1 : 0);
+				}
+			}
+			cur->rx_used += (uint16_t)chunk;
+			n += chunk;
+			continue;
+		}
+		rec = mbreplay_peek(cur, channel, port);
+		if (rec == 0 || rec[9] != MBCAP_DIR_READ) break;
+		mbreplay_take(cur, rec);
+		cur->rx = rec + replay.record_header;
+		cur->rx_len = mbcap_get_u16(&rec[10]);
+		cur->rx_used = 0;
+	}
+	return n;
+}
+
+#define MBREPLAY_PORT_WRAPPERS(p) \
+static uint32_t mbreplay_COM_read_##p(uint8_t* pBuf, uint16_t BytesToRead, uint16_t timout) { (void)timout; return mbreplay_read(&replay.port[p], MBCAP_CHANNEL_RTU, p, pBuf, BytesToRead); } \
+static uint32_t mbreplay_COM_write_##p(uint8_t* pBuff, uint16_t BytesToWrite, uint16_t timout) { (void)timout; return mbreplay_write(&replay.port[p], MBCAP_CHANNEL_RTU, p, pBuff, BytesToWrite); } \
+static uint32_t mbreplay_NET_read_##p(void* net, uint8_t* pBuf, uint16_t BytesToRead, uint16_t timout) { (void)net; return mbreplay_COM_read_##p(pBuf, BytesToRead, timout); } \
+static uint32_t mbreplay_NET_write_##p(void* net, uint8_t* pBuff, uint16_t BytesToWrite, uint16_t timout) { (void)net; return mbreplay_COM_write_##p(pBuff, BytesToWrite, timout); }
+
+MBREPLAY_PORT_WRAPPERS(0)
+MBREPLAY_PORT_WRAPPERS(1)
+MBREPLAY_PORT_WRAPPERS(2)
+MBREPLAY_PORT_WRAPPERS(3)
+
+#define MBREPLAY_PORT(p) { mbreplay_COM_read_##p, mbreplay_COM_write_##p, mbreplay_NET_read_##p, mbreplay_NET_write_##p }
+
+static const MBCAP_PortTypeDef mbreplay_ports[MBCAP_MAX_PORTS] = {
+	MBREPLAY_PORT(0), MBREPLAY_PORT(1), MBREPLAY_PORT(2), MBREPLAY_PORT(3)
+};
+
+/*
+*	@brief: make an RTU handle talk to the replay file instead of a COM port or socket.
+*			handles get port numbers in the order they are attached, as with MBCAP_attach
+*	@param: pointer to handle that controls the communication bus( COM port)
+*	@return: 0 on success
+*/
+int MBREPLAY_attach(MODBUS_HandleTypeDef* bus) {
+	int port;
+	if (replay.base == 0) return -1;
+	port = mbcap_port_take(replay.bus, bus);
+	if (port < 0) return -1;
+	mbcap_port_install(bus, &mbreplay_ports[port], 0);
+	return 0;
+}
+
+#ifdef MBREPLAY_ETHERNET
+int initialize_ethernet(network_HANDLE *device) {
+	(void)device;
+	return replay.base ? 0 : -1;
+}
+
+int write_ethernet(uint8_t *buff, uint32_t numBytestoWrite) {
+	replay.tcp_used = 1;
+	return (int)mbreplay_write(&replay.tcp, MBCAP_CHANNEL_TCP, 0, buff, numBytestoWrite);
+}
+
+int read_ethernet(uint8_t *buf, uint32_t numBytestoRead) {
+	return (int)mbreplay_read(&replay.tcp, MBCAP_CHANNEL_TCP, 0, buf, numBytestoRead);
+}
+
+int Deinitialize_ethernet() {
+	return 0;
+}
+#endif
+/*************************** End of file ****************************/
@@ -0,0 +1,82 @@
+/*************************************************************************
+ *	file : mbcapture.h
+ *	binary capture of modbus traffic and replay from the capture file
+ *	Author : agent
+ *	Date : October 2026
+ *
+ *	Capture file layout, all fields little endian :
+ *		header : "MBCP" , uint16 version , uint16 reserved
+ *		record : uint64 timestamp (ns, monotonic) , uint8 channel ,
+ *				 uint8 direction , uint16 length , uint8 port ,
+ *				 length bytes of data
+ *	port tells the handles of MBCAP_attach apart (0 for the TCP channel).
+ *	Version 1 records have no port byte, replay reads them as port 0.
+ *	Every COM_write / write_ethernet call and every non empty COM_read /
+ *	read_ethernet call becomes one record. Files are only ever appended.
+ *	Every MBCAP_open starts with a session record : channel
+ *	MBCAP_CHANNEL_SESSION, direction MBCAP_DIR_WRITE, length 0. The clock
+ *	of an earlier session (or boot) says nothing about the gap before it,
+ *	replay restarts its timing there.
+ *
+ *************************************************************************
+ */
+
+#ifndef __MBCAPTURE_H
+#define __MBCAPTURE_H
+
+#include <stdint.h>
+#include "modbus.h"
+
+#define MBCAP_VERSION               ( 2 )
+#define MBCAP_HEADER_SIZE           ( 8 )
+#define MBCAP_RECORD_HEADER_SIZE    ( 13 )
+#define MBCAP_RECORD_HEADER_SIZE_V1 ( 12 )
+#define MBCAP_MAX_PORTS             ( 4 )   /*! handles recorded / replayed at the same time */
+
+#define MBCAP_CHANNEL_RTU           ( 0 )
+#define MBCAP_CHANNEL_TCP           ( 1 )
+#define MBCAP_CHANNEL_SESSION       ( 0xff ) /*! start of a capture session, no data */
+
+#define MBCAP_DIR_WRITE             ( 0 )
+#define MBCAP_DIR_READ              ( 1 )
+
+#define MBREPLAY_SPEED_ORIGINAL     ( 0 ) /*! keep the recorded gaps between frames. */
+#define MBREPLAY_SPEED_MAX          ( 1 ) /*! feed the frames back as fast as they are asked for. */
+
+/*
+ * Capture : only one capture file is open at a time. MBCAP_attach swaps the
+ * COM_read / COM_write pointers of an RTU handle for recording wrappers, or
+ * NET_read / NET_write when MODBUS_NET_attach was called before it. Up to
+ * MBCAP_MAX_PORTS handles are recorded together, each gets the lowest free
+ * port number. MBCAP_open refuses to append to a file of an other version.
+ * For the TCP library, build tcp_modbus.c and mbcapture.c with
+ * TCP_MODBUS_CAPTURE defined, which routes read_ethernet / write_ethernet
+ * through MBCAP_read_ethernet / MBCAP_write_ethernet.
+ */
+int MBCAP_open(const char* file_name);
+int MBCAP_close(void);
+int MBCAP_attach(MODBUS_HandleTypeDef* bus);
+int MBCAP_detach(MODBUS_HandleTypeDef* bus);
+#ifdef TCP_MODBUS_CAPTURE
+int MBCAP_write_ethernet(uint8_t *buff, uint32_t numBytestoWrite);
+int MBCAP_read_ethernet(uint8_t *buf, uint32_t numBytestoRead);
+#endif
+
+/*
+ * Replay : the capture file is memory mapped and its frames are handed back
+ * to modbus.c / tcp_modbus.c. Each write consumes the next recorded write of
+ * the port, reads are served from the recorded reads that follow it.
+ * Every port keeps its own position in the file, so the handles can be
+ * polled in any order. MBREPLAY_attach replaces the COM (or NET) functions
+ * of an RTU handle and numbers the handles like MBCAP_attach does : attach
+ * them in the same order as while capturing. Building mbcapture.c with
+ * MBREPLAY_ETHERNET defined provides initialize_ethernet, write_ethernet,
+ * read_ethernet and Deinitialize_ethernet for tcp_modbus.c.
+ */
+int MBREPLAY_open(const char* file_name, uint8_t speed);
+int MBREPLAY_close(void);
+int MBREPLAY_attach(MODBUS_HandleTypeDef* bus);
+int MBREPLAY_end(void);
+
+#endif
+/*************************** End of file ****************************/
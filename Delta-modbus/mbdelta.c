@@ -0,0 +1,187 @@
+/*************************************************************************
+ *	file : mbdelta.c
+ *	report-by-exception change detection over polled modbus blocks
+ *	Author : agent
+ *	Date : October 2026
+ *
+ *	A scan is first compared against the stored image eight registers at
+ *	a time (SSE2 / NEON when the compiler offers them, plain 32-bit words
+ *	otherwise) to find the changed window. Only tags inside that window
+ *	are decoded and checked against their deadband, so a scan with nothing
+ *	changed costs two block compares and no callback.
+ *
+ *************************************************************************
+ */
+
+#include "mbdelta.h"
+#include "string.h"
+#include "math.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MBDELTA_USE_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define MBDELTA_USE_NEON
+#endif
+
+#define MBDELTA_CHUNK	( 8 ) // registers compared per step
+
+/*
+ * @brief : compare MBDELTA_CHUNK registers of two images
+ * @param : first image
+ * @param : second image
+ * @ret	 : non zero if any register differs
+ */
+static int mbdelta_chunk_differs(const uint16_t* a, const uint16_t* b) {
+#if defined(MBDELTA_USE_SSE2)
+	__m128i va = _mm_loadu_si128((const __m128i*)a);
+	__m128i vb = _mm_loadu_si128((const __m128i*)b);
+	return _mm_movemask_epi8(_mm_cmpeq_epi16(va, vb)) != 0xFFFF;
+#elif defined(MBDELTA_USE_NEON)
+	uint16x8_t eq = vceqq_u16(vld1q_u16(a), vld1q_u16(b));
+	return vminvq_u16(eq) != 0xFFFF;
+#else
+	uint32_t wa[4], wb[4];
+	memcpy(wa, a, sizeof(wa));
+	memcpy(wb, b, sizeof(wb));
+	return ((wa[0] ^ wb[0]) | (wa[1] ^ wb[1]) | (wa[2] ^ wb[2]) | (wa[3] ^ wb[3])) != 0;
+#endif
+}
+
+/*
+ * @brief : find the first and the last changed register of a scan
+ * @param : stored image
+ * @param : new scan
+ * @param : number of registers
+ * @param : first changed register index
+ * @param : last changed register index
+ * @ret	 : 0 if nothing changed, 1 otherwise
+ */
+static int mbdelta_changed_range(const uint16_t* image, const uint16_t* scan, uint16_t n, uint16_t* first, uint16_t* last) {
+	uint16_t lo = 0, hi = n;
+	while (n - lo >= MBDELTA_CHUNK && !mbdelta_chunk_differs(image + lo, scan + lo)) lo += MBDELTA_CHUNK;
+	while (lo < n && image[lo] == scan[lo]) lo++;
+	if (lo == n) return 0;
+	while (hi - lo >= MBDELTA_CHUNK && !mbdelta_chunk_differs(image + hi - MBDELTA_CHUNK, scan + hi - MBDELTA_CHUNK)) hi -= MBDELTA_CHUNK;
+	while (image[hi - 1] == scan[hi - 1]) hi--; // stops at lo at the latest
+	*first = lo;
+	*last = hi - 1;
+	return 1;
+}
+
+/*
+ * @brief : number of registers a tag occupies
+ * @param : tag
+ * @ret	 : 1 or 2
+ */
+static uint16_t mbdelta_tag_width(const MBDELTA_TagTypeDef* tag) {
+	switch (tag->type) {
+	case MBDELTA_TYPE_UINT32:
+	case MBDELTA_TYPE_INT32:
+	case MBDELTA_TYPE_FLOAT32:
+		return 2;
+	default:
+		return 1;
+	}
+}
+
+/*
+ * @brief : decode the value of a tag from a register image
+ * @param : tag
+ * @param : register image
+ * @ret	 : decoded value
+ */
+static double mbdelta_decode(const MBDELTA_TagTypeDef* tag, const uint16_t* registers) {
+	const uint16_t* r = registers + tag->offset;
+	uint32_t u;
+	float f;
+	switch (tag->type) {
+	case MBDELTA_TYPE_UINT16:
+		return r[0];
+	case MBDELTA_TYPE_INT16:
+		return (int16_t)r[0];
+	case MBDELTA_TYPE_BIT:
+		return (r[0] >> tag->bit) & 0x01;
+	default:
+		break;
+	}
+	if (tag->flags & MBDELTA_FLAG_WORD_SWAP) u = ((uint32_t)r[1] << 16) | r[0];
+	else u = ((uint32_t)r[0] << 16) | r[1];
+	if (tag->type == MBDELTA_TYPE_UINT32) return u;
+	if (tag->type == MBDELTA_TYPE_INT32) return (int32_t)u;
+	memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+/*
+ * @brief : check a block configuration and mark it as not primed,
+ *			the first update after this reports every tag
+ * @param : pointer to the block, image, tags and batch filled in by the user
+ * @ret	 : success(0) or fail response
+ */
+int MBDELTA_init(MBDELTA_BlockTypeDef* block) {
+	uint16_t prev_offset = 0;
+	block->primed = 0;
+	if (block->image == 0 || block->number_of_registers == 0) return -1;
+	if (block->number_of_tags && block->tags == 0) return -1;
+	if (block->batch == 0 || block->batch_size == 0) return -1;
+	for (uint16_t i = 0; i < block->number_of_tags; i++) {
+		MBDELTA_TagTypeDef* tag = &block->tags[i];
+		if (tag->type > MBDELTA_TYPE_BIT) return -1;
+		if (tag->type == MBDELTA_TYPE_BIT && tag->bit > 15) return -1;
+		if ((uint32_t)tag->offset + mbdelta_tag_width(tag) > block->number_of_registers) return -1;
+		if (tag->offset < prev_offset) return -1; // table must be sorted
+		prev_offset = tag->offset;
+		tag->last_value = 0;
+	}
+	return 0;
+}
+
+/*
+ * @brief : feed a new scan of the block, report changed tags and store the scan
+ * @param : pointer to the block
+ * @param : register data in host byte order (read with change_high_low_flag set)
+ * @param : number of registers, must match the block
+ * @ret	 : number of reported tags or -1 on fail
+ */
+int MBDELTA_update(MBDELTA_BlockTypeDef* block, const uint16_t* registers, uint16_t number_of_registers) {
+	uint16_t first, last;
+	uint16_t count = 0;
+	int reported = 0;
+	if (number_of_registers != block->number_of_registers) return -1;
+	if (block->primed) {
+		if (!mbdelta_changed_range(block->image, registers, number_of_registers, &first, &last)) return 0;
+	}
+	else {
+		first = 0;
+		last = number_of_registers - 1;
+	}
+	for (uint16_t i = 0; i < block->number_of_tags; i++) {
+		MBDELTA_TagTypeDef* tag = &block->tags[i];
+		uint16_t width = mbdelta_tag_width(tag);
+		double value;
+		if (tag->offset + width - 1 < first) continue;
+		if (tag->offset > last) break;
+		if (block->primed) {
+			if (memcmp(&registers[tag->offset], &block->image[tag->offset], width * sizeof(uint16_t)) == 0) continue;
+		}
+		value = mbdelta_decode(tag, registers);
+		// a NaN difference compares false, so float tags going to or from NaN are reported
+		if (block->primed && fabs(value - tag->last_value) <= tag->deadband) continue;
+		tag->last_value = value;
+		block->batch[count].tag = i;
+		block->batch[count].value = value;
+		count++;
+		reported++;
+		if (count == block->batch_size) {
+			if (block->on_change) block->on_change(block, block->batch, count);
+			count = 0;
+		}
+	}
+	if (count && block->on_change) block->on_change(block, block->batch, count);
+	memcpy(&block->image[first], &registers[first], (last - first + 1) * sizeof(uint16_t));
+	block->primed = 1;
+	return reported;
+}
+/*************************** End of file ****************************/
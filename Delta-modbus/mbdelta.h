@@ -0,0 +1,63 @@
+/*************************************************************************
+ *	file : mbdelta.h
+ *	report-by-exception change detection over polled modbus blocks
+ *	Author : agent
+ *	Date : October 2026
+ *
+ *	Keeps the previous image of a polled register block, compares every
+ *	new scan against it and hands only the tags whose decoded value moved
+ *	more than their deadband to a subscriber callback, as a delta batch.
+ *
+ *************************************************************************
+ */
+
+#ifndef __MBDELTA_H
+#define __MBDELTA_H
+
+#include <stdint.h>
+
+#define MBDELTA_TYPE_UINT16         ( 0 )
+#define MBDELTA_TYPE_INT16          ( 1 )
+#define MBDELTA_TYPE_UINT32         ( 2 )
+#define MBDELTA_TYPE_INT32          ( 3 )
+#define MBDELTA_TYPE_FLOAT32        ( 4 )
+#define MBDELTA_TYPE_BIT            ( 5 )
+
+#define MBDELTA_FLAG_WORD_SWAP      ( 0x01 ) /*! 32-bit tags : low word is stored in the first register. */
+
+typedef struct
+{
+	uint16_t offset;        // register index of the tag inside the block
+	uint8_t type;           // MBDELTA_TYPE_xxx
+	uint8_t bit;            // bit number for MBDELTA_TYPE_BIT (0..15)
+	uint8_t flags;          // MBDELTA_FLAG_xxx
+	double deadband;        // change smaller or equal to this is not reported
+
+	double last_value;      // last reported value, maintained by the library
+} MBDELTA_TagTypeDef;
+
+typedef struct
+{
+	uint16_t tag;           // index into the block tag table
+	double value;           // new decoded value
+} MBDELTA_ItemTypeDef;
+
+typedef struct __MBDELTA_BlockTypeDef
+{
+	uint16_t* image;                // previous scan, number_of_registers long, provided by user
+	uint16_t number_of_registers;
+	MBDELTA_TagTypeDef* tags;       // tag table sorted by offset, provided by user
+	uint16_t number_of_tags;
+	MBDELTA_ItemTypeDef* batch;     // delta batch buffer, provided by user
+	uint16_t batch_size;
+	uint8_t primed;                 // 0 until the first scan has been stored
+
+	void(*on_change)(struct __MBDELTA_BlockTypeDef* block, const MBDELTA_ItemTypeDef* items, uint16_t count);
+	void* user_data;
+} MBDELTA_BlockTypeDef;
+
+int MBDELTA_init(MBDELTA_BlockTypeDef* block);
+int MBDELTA_update(MBDELTA_BlockTypeDef* block, const uint16_t* registers, uint16_t number_of_registers);
+
+#endif
+/*************************** End of file ****************************/
@@ -11,4 +11,23 @@
 
 uint16_t usMBCRC16(uint8_t * pucFrame, uint16_t usLen, uint8_t ucCRCHi, uint8_t ucCRCLo);
 
+/*
+ * Compile-time CRC16 of a 6-byte request frame (address, function and four
+ * data bytes) seeded with 0xFFFF, equal to usMBCRC16(frame, 6, 0xff, 0xff).
+ * The CRC is linear, so the result is the CRC of an all-zero frame xor the
+ * contribution of every set bit; each argument is expanded only once per bit
+ * and the whole expression folds to a constant when the bytes are constants.
+ */
+#define MB_CRC16_BIT(b, i, k)	( (((b) >> (i)) & 0x01) ? (k) : 0 )
+#define MB_CRC16_BYTE(b, k0, k1, k2, k3, k4, k5, k6, k7) \
+	( MB_CRC16_BIT(b, 0, k0) ^ MB_CRC16_BIT(b, 1, k1) ^ MB_CRC16_BIT(b, 2, k2) ^ MB_CRC16_BIT(b, 3, k3) ^ \
+	  MB_CRC16_BIT(b, 4, k4) ^ MB_CRC16_BIT(b, 5, k5) ^ MB_CRC16_BIT(b, 6, k6) ^ MB_CRC16_BIT(b, 7, k7) )
+#define MB_CRC16_FRAME6(b0, b1, b2, b3, b4, b5) ( (uint16_t)( 0x1B00 ^ \
+	MB_CRC16_BYTE(b0, 0xD101, 0xE201, 0x8401, 0x4801, 0x9002, 0x6007, 0xC00E, 0xC01F) ^ \
+	MB_CRC16_BYTE(b1, 0xC03D, 0xC079, 0xC0F1, 0xC1E1, 0xC3C1, 0xC781, 0xCF01, 0xDE01) ^ \
+	MB_CRC16_BYTE(b2, 0xFC01, 0xB801, 0x3001, 0x6002, 0xC004, 0xC00B, 0xC015, 0xC029) ^ \
+	MB_CRC16_BYTE(b3, 0xC051, 0xC0A1, 0xC141, 0xC281, 0xC501, 0xCA01, 0xD401, 0xE801) ^ \
+	MB_CRC16_BYTE(b4, 0x9001, 0x6001, 0xC002, 0xC007, 0xC00D, 0xC019, 0xC031, 0xC061) ^ \
+	MB_CRC16_BYTE(b5, 0xC0C1, 0xC181, 0xC301, 0xC601, 0xCC01, 0xD801, 0xF001, 0xA001) ) )
+
 #endif
\ No newline at end of file
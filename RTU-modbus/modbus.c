@@ -15,46 +15,175 @@
 #include "modbus.h"
 #include "stdio.h"
 #include "string.h"
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+static uint32_t jitter_seed = 0x2545F491;
 
 static uint16_t change_high_low(uint16_t a) {
 	uint8_t h;
 	h = a >> 8;
 	return (a << 8 | (uint16_t)h);
 }
+
+static uint32_t MODBUS_bus_read(MODBUS_HandleTypeDef* bus, uint8_t* pBuf, uint16_t BytesToRead, uint16_t timeout) {
+	if (bus->net) return bus->NET_read(bus->net, pBuf, BytesToRead, timeout);
+	return bus->COM_read(pBuf, BytesToRead, timeout);
+}
+
+static uint32_t MODBUS_bus_write(MODBUS_HandleTypeDef* bus, uint8_t* pBuff, uint16_t BytesToWrite, uint16_t timeout) {
+	if (bus->net) return bus->NET_write(bus->net, pBuff, BytesToWrite, timeout);
+	return bus->COM_write(pBuff, BytesToWrite, timeout);
+}
+
+static uint32_t MODBUS_tick(void) {
+	#ifndef WIN32
+	return HAL_GetTick();
+	#else
+	return GetTickCount();
+	#endif
+}
+
+static void MODBUS_delay(uint32_t ms) {
+	#ifndef WIN32
+	HAL_Delay(ms);
+	#else
+	Sleep(ms);
+	#endif
+}
+
 /*
- * @brief : Universal function for reading the input from the slave
- * @param : pointer to handle that controls the communication bus( COM port), defined in modbus.h
- * @param : modbus read function
+ * @brief : upper bound of the response timeout of every slave
+ */
+static uint16_t MODBUS_rto_max(MODBUS_HandleTypeDef* bus) {
+	return bus->response_timeout > MODBUS_RTO_MIN ? bus->response_timeout : MODBUS_RTO_MIN;
+}
+
+/*
+ * @brief : prepare one attempt of a transaction, apply the circuit breaker and the retry backoff
+ * @param : pointer to handle that controls the communication bus( COM port)
  * @param : modbus slave address
- * @param : coil staring address
- * @param : number of coils to read
+ * @param : attempt number, 0 for the first one
+ * @param : response timeout to use for this attempt
+ * @param : tick at the start of the attempt
+ * @ret	 : 0 to go on or MODBUS_SLAVE_OFFLINE
+ */
+static int MODBUS_attempt_begin(MODBUS_HandleTypeDef* bus, uint8_t slave_address, uint8_t attempt, uint16_t* timeout, uint32_t* start) {
+	MODBUS_SlaveTypeDef* slave;
+	uint32_t rto, backoff;
+	*timeout = bus->response_timeout;
+	if (bus->slaves == 0 || slave_address == MB_ADDRESS_BROADCAST || slave_address > MB_ADDRESS_MAX) { // broadcasts are never answered
+		*start = MODBUS_tick();
+		return 0;
+	}
+	slave = &bus->slaves[slave_address];
+	if (slave->offline && (int32_t)(MODBUS_tick() - slave->next_probe) < 0) return MODBUS_SLAVE_OFFLINE;
+	rto = slave->rto ? slave->rto : MODBUS_rto_max(bus);
+	if (attempt) {
+		// exponential backoff of the timeout, full jitter on the delay before the retry,
+		// both stop growing after MODBUS_BACKOFF_SHIFT_MAX doublings
+		uint8_t shift = attempt > MODBUS_BACKOFF_SHIFT_MAX ? MODBUS_BACKOFF_SHIFT_MAX : attempt;
+		rto <<= shift;
+		jitter_seed ^= jitter_seed << 13;
+		jitter_seed ^= jitter_seed >> 17;
+		jitter_seed ^= jitter_seed << 5;
+		backoff = (uint32_t)MODBUS_RETRY_BACKOFF << shift;
+		if (backoff > MODBUS_rto_max(bus)) backoff = MODBUS_rto_max(bus);
+		MODBUS_delay(jitter_seed % (backoff + 1));
+	}
+	if (rto > MODBUS_rto_max(bus)) rto = MODBUS_rto_max(bus);
+	*timeout = (uint16_t)rto;
+	*start = MODBUS_tick();
+	return 0;
+}
+
+/*
+ * @brief : account the result of one attempt of a transaction
+ * @param : pointer to handle that controls the communication bus( COM port)
+ * @param : modbus slave address
+ * @param : result of the attempt, -1 when the slave did not answer properly
+ * @param : tick at the start of the attempt
+ * @param : attempt number, 0 for the first one
+ * @ret	 : 1 if the transaction should be attempted again
+ */
+static int MODBUS_attempt_end(MODBUS_HandleTypeDef* bus, uint8_t slave_address, int result, uint32_t start, uint8_t attempt) {
+	MODBUS_SlaveTypeDef* slave;
+	uint32_t rtt, rto;
+	if (bus->slaves == 0 || slave_address == MB_ADDRESS_BROADCAST || slave_address > MB_ADDRESS_MAX) return 0;
+	slave = &bus->slaves[slave_address];
+	if (result != -1) { // a response, exception responses included
+		if (attempt == 0) { // Karn : no samples from retried requests
+			rtt = MODBUS_tick() - start;
+			if (rtt > 0x0fff) rtt = 0x0fff;
+			if (slave->srtt == 0) {
+				slave->srtt = (uint16_t)((rtt << 3) | 1);
+				slave->rttvar = (uint16_t)(rtt << 1);
+			}
+			else {
+				int32_t delta = (int32_t)rtt - (slave->srtt >> 3);
+				if (delta < 0) delta = -delta;
+				slave->rttvar = (uint16_t)(slave->rttvar - (slave->rttvar >> 2) + delta);
+				slave->srtt = (uint16_t)(slave->srtt - (slave->srtt >> 3) + rtt);
+				if (slave->srtt == 0) slave->srtt = 1;
+			}
+			rto = (slave->srtt >> 3) + (slave->rttvar > 1 ? slave->rttvar : 1);
+			if (rto < MODBUS_RTO_MIN) rto = MODBUS_RTO_MIN;
+			if (rto > MODBUS_rto_max(bus)) rto = MODBUS_rto_max(bus);
+			slave->rto = (uint16_t)rto;
+		}
+		slave->failures = 0;
+		slave->offline = 0;
+		return 0;
+	}
+	if (!slave->offline && attempt < bus->retries) return 1;
+	// transaction failed, keep the backed off timeout until the next sample
+	if (slave->rto) {
+		rto = (uint32_t)slave->rto << 1;
+		slave->rto = (uint16_t)(rto > MODBUS_rto_max(bus) ? MODBUS_rto_max(bus) : rto);
+	}
+	if (slave->failures < 0xff) slave->failures++;
+	if (slave->offline || slave->failures >= MODBUS_BREAKER_THRESHOLD) {
+		slave->offline = 1;
+		slave->next_probe = MODBUS_tick() + MODBUS_BREAKER_PROBE_PERIOD;
+	}
+	return 0;
+}
+/*
+ * @brief : send a complete 8-byte read request and receive the response, single attempt
+ * @param : pointer to handle that controls the communication bus( COM port), defined in modbus.h
+ * @param : request frame including CRC, slave address and function are taken from it
  * @param : read data from slave
  * @param : lenght of data array
- * @ret	 : success(0) or fail response
+ * @param : response timeout
+ * @ret	 : success(0), exception code or fail(-1) response
  */
-int MODBUS_read_function(MODBUS_HandleTypeDef* bus,uint8_t function ,uint8_t slave_address, uint16_t starting_address, uint16_t number_of_points, uint8_t* response_data, uint8_t* response_len) {
+static int MODBUS_read_exchange(MODBUS_HandleTypeDef* bus, const uint8_t* request, uint8_t* response_data, uint8_t* response_len, uint16_t timeout) {
 	uint8_t data_transfer[10];
+	uint8_t slave_address = request[0];
+	uint8_t function = request[1];
 	uint16_t CRC16, CRC16_read;
 	uint8_t L;
+	uint16_t expected;
 	uint32_t start_time;
 	*response_len = 0;
-	data_transfer[0] = slave_address;
-	data_transfer[1] = function; 
-	data_transfer[2] = (uint8_t)(starting_address >> 8);
-	data_transfer[3] = (uint8_t)(starting_address & 0x00ff);
-	data_transfer[4] = (uint8_t)(number_of_points >> 8);
-	data_transfer[5] = (uint8_t)(number_of_points & 0x00ff);
-	CRC16 = usMBCRC16(data_transfer, 6 , 0xff , 0xff);
-	data_transfer[6] = (uint8_t)(CRC16 & 0x00ff); // CRC16 low byte first
-	data_transfer[7] = (uint8_t)(CRC16 >> 8);
 
-	bus->COM_write(data_transfer, 8, bus->response_timeout);
+	MODBUS_bus_write(bus, (uint8_t*)request, 8, timeout); // the bus does not modify the buffer
 
-	bus->COM_read(data_transfer, 3, bus->response_timeout);
+	if (MODBUS_bus_read(bus, data_transfer, 3, timeout) != 3) return -1; // no response
 	if (data_transfer[0] != slave_address) return - 1; //fail
+	if (data_transfer[1] == (function | MB_FUNC_ERROR)) { // exception response : address, function, code, CRC16
+		if (MODBUS_bus_read(bus, &data_transfer[3], 2, timeout) != 2) return -1;
+		CRC16_read = ((uint16_t)(data_transfer[4]) << 8) | data_transfer[3];
+		CRC16 = usMBCRC16(data_transfer, 3 , 0xff , 0xff);
+		if (CRC16 != CRC16_read || data_transfer[2] == 0) return -1;
+		return data_transfer[2]; //retrun exception code
+	}
 	if (data_transfer[1] != function) return -1; //fail
 
 	L = data_transfer[2];
+	expected = MODBUS_read_response_bytes(request);
+	if (expected && L != expected) return -1; // response to an other request
 	uint16_t read_bytes = 0 ;
 	#ifndef WIN32
 	start_time = HAL_GetTick();
@@ -62,7 +191,7 @@ int MODBUS_read_function(MODBUS_HandleTypeDef* bus,uint8_t function ,uint8_t sla
 	start_time = 0;
 	#endif
 	do{
-		read_bytes += bus->COM_read(response_data + read_bytes, L - read_bytes , bus->response_timeout);
+		read_bytes += MODBUS_bus_read(bus, response_data + read_bytes, L - read_bytes , timeout);
 		#ifndef WIN32
 		if( HAL_GetTick() - start_time > 350) return -1;
 		#else
@@ -71,7 +200,7 @@ int MODBUS_read_function(MODBUS_HandleTypeDef* bus,uint8_t function ,uint8_t sla
 	}
 	while(  read_bytes < L );
 	//CRC16_read = ((uint16_t)(response_data[L + 1]) << 8 ) | response_data[ L ];
-	bus->COM_read(&data_transfer[3], 2, bus->response_timeout);
+	MODBUS_bus_read(bus, &data_transfer[3], 2, timeout);
 	CRC16_read = ((uint16_t)(data_transfer[4]) << 8) | data_transfer[3];
 	CRC16 = usMBCRC16(data_transfer, 3 , 0xff , 0xff);
 	CRC16 = usMBCRC16(response_data, L ,CRC16 >> 8, CRC16 & 0xff);
@@ -79,6 +208,94 @@ int MODBUS_read_function(MODBUS_HandleTypeDef* bus,uint8_t function ,uint8_t sla
 	*response_len = L;
 	return 0;
 }
+/*
+ * @brief : send a complete 8-byte read request and receive the response
+ * @param : pointer to handle that controls the communication bus( COM port), defined in modbus.h
+ * @param : request frame including CRC, slave address and function are taken from it
+ * @param : read data from slave
+ * @param : lenght of data array
+ * @ret	 : success(0) or fail response
+ */
+static int MODBUS_read_frame(MODBUS_HandleTypeDef* bus, const uint8_t* request, uint8_t* response_data, uint8_t* response_len) {
+	uint8_t attempt = 0;
+	uint16_t timeout;
+	uint32_t start;
+	int ret_val;
+	do {
+		*response_len = 0;
+		ret_val = MODBUS_attempt_begin(bus, request[0], attempt, &timeout, &start);
+		if (ret_val != 0) return ret_val;
+		ret_val = MODBUS_read_exchange(bus, request, response_data, response_len, timeout);
+	} while (MODBUS_attempt_end(bus, request[0], ret_val, start, attempt++));
+	return ret_val;
+}
+/*
+ * @brief : byte count a slave must answer to a read request, RTU frames carry no
+ *			transaction id so this is what tells a late response from the expected one
+ * @param : request frame
+ * @ret	 : number of data bytes, 0 if the function is not a 0x01 to 0x04 read
+ */
+uint16_t MODBUS_read_response_bytes(const uint8_t* request) {
+	uint16_t number_of_points = ((uint16_t)request[4] << 8) | request[5];
+	switch (request[1]) {
+	case MB_FUNC_READ_COILS:
+	case MB_FUNC_READ_DISCRETE_INPUTS:
+		return (number_of_points + 7) / 8;
+	case MB_FUNC_READ_HOLDING_REGISTER:
+	case MB_FUNC_READ_INPUT_REGISTER:
+		return number_of_points * 2;
+	default:
+		return 0;
+	}
+}
+/*
+ * @brief : build a read request frame at run time, see MODBUS_READ_REQUEST for fixed ones
+ * @param : request to fill in
+ * @param : modbus read function
+ * @param : modbus slave address
+ * @param : coil staring address
+ * @param : number of coils to read
+ */
+void MODBUS_build_read_request(MODBUS_RequestTypeDef* request, uint8_t function, uint8_t slave_address, uint16_t starting_address, uint16_t number_of_points) {
+	uint8_t* data_transfer = request->frame;
+	uint16_t CRC16;
+	data_transfer[0] = slave_address;
+	data_transfer[1] = function; 
+	data_transfer[2] = (uint8_t)(starting_address >> 8);
+	data_transfer[3] = (uint8_t)(starting_address & 0x00ff);
+	data_transfer[4] = (uint8_t)(number_of_points >> 8);
+	data_transfer[5] = (uint8_t)(number_of_points & 0x00ff);
+	CRC16 = usMBCRC16(data_transfer, 6 , 0xff , 0xff);
+	data_transfer[6] = (uint8_t)(CRC16 & 0x00ff); // CRC16 low byte first
+	data_transfer[7] = (uint8_t)(CRC16 >> 8);
+}
+/*
+ * @brief : Universal function for reading the input from the slave
+ * @param : pointer to handle that controls the communication bus( COM port), defined in modbus.h
+ * @param : modbus read function
+ * @param : modbus slave address
+ * @param : coil staring address
+ * @param : number of coils to read
+ * @param : read data from slave
+ * @param : lenght of data array
+ * @ret	 : success(0) or fail response
+ */
+int MODBUS_read_function(MODBUS_HandleTypeDef* bus,uint8_t function ,uint8_t slave_address, uint16_t starting_address, uint16_t number_of_points, uint8_t* response_data, uint8_t* response_len) {
+	MODBUS_RequestTypeDef request;
+	MODBUS_build_read_request(&request, function, slave_address, starting_address, number_of_points);
+	return MODBUS_read_frame(bus, request.frame, response_data, response_len);
+}
+/*
+ * @brief : send a pre-built read request, see MODBUS_READ_REQUEST in modbus.h
+ * @param : pointer to handle that controls the communication bus( COM port), defined in modbus.h
+ * @param : pre-built request
+ * @param : read data from slave, raw bytes as sent by the slave
+ * @param : lenght of data array
+ * @ret	 : success(0) or fail response
+ */
+int MODBUS_read_request(MODBUS_HandleTypeDef* bus, const MODBUS_RequestTypeDef* request, uint8_t* response_data, uint8_t* response_len) {
+	return MODBUS_read_frame(bus, request->frame, response_data, response_len);
+}
 /*
 * @brief : modbus read coil status Function 0x01
 * @param : pointer to handle that controls the communication bus( COM port)
@@ -153,40 +370,82 @@ int MODBUS_read_input_registers(MODBUS_HandleTypeDef* bus, uint8_t slave_address
 	return ret_val;
 }
 
-
 /*
-* @brief : universal function for writing single data to slave
+* @brief : read an address range of any size, chunk by chunk, into a sink
 * @param : pointer to handle that controls the communication bus( COM port)
-* @param : modbus function
+* @param : modbus read function, 0x01 to 0x04
 * @param : modbus slave address
+* @param : first address of the range
+* @param : number of coils / registers, the range may not go past address 65535
+* @param : change high and low bytes of 16-bit data
+* @param : called with every chunk, see MODBUS_SinkTypeDef
+* @param : passed to the sink
+* @ret	 : success(0), exception code of the slave, -1 on failure, or the non zero return of the sink
+*/
+int MODBUS_read_stream(MODBUS_HandleTypeDef* bus, uint8_t function, uint8_t slave_address, uint16_t starting_address, size_t number_of_points, uint8_t change_high_low_flag, MODBUS_SinkTypeDef sink, void* context) {
+	uint16_t chunk_data[MODBUS_MAX_READ_REGISTERS + 3]; // 16-bit aligned response buffer
+	uint32_t address = starting_address;
+	size_t max_points, points;
+	uint8_t L;
+	int ret_val;
+	switch (function) {
+	case MB_FUNC_READ_COILS:
+	case MB_FUNC_READ_DISCRETE_INPUTS:
+		max_points = MODBUS_MAX_READ_BITS;
+		break;
+	case MB_FUNC_READ_HOLDING_REGISTER:
+	case MB_FUNC_READ_INPUT_REGISTER:
+		max_points = MODBUS_MAX_READ_REGISTERS;
+		break;
+	default:
+		return -1;
+	}
+	if (number_of_points == 0 || number_of_points > 0x10000u - starting_address) return -1; // crosses address 65535
+	while (number_of_points) {
+		points = number_of_points < max_points ? number_of_points : max_points;
+		ret_val = MODBUS_read_function(bus, function, slave_address, (uint16_t)address, (uint16_t)points, (uint8_t*)chunk_data, &L);
+		if (ret_val != 0) return ret_val;
+		if (max_points == MODBUS_MAX_READ_REGISTERS) {
+			if (L != points * 2) return -1;
+			if (change_high_low_flag) {
+				for (int i = 0; i < (L / 2); i++) {
+					chunk_data[i] = change_high_low(chunk_data[i]);
+				}
+			}
+		}
+		else if (L != (points + 7) / 8) return -1;
+		ret_val = sink(context, (uint16_t)address, (uint16_t)points, (const uint8_t*)chunk_data, L);
+		if (ret_val != 0) return ret_val;
+		address += points;
+		number_of_points -= points;
+	}
+	return 0;
+}
+
+/*
+* @brief : send a single write request and check the echo, single attempt
+* @param : pointer to handle that controls the communication bus( COM port)
+* @param : request frame including CRC
 * @param : coil staring address
 * @param : preset data
+* @param : response timeout
 * @ret	 : success(0) or fail response
 */
-int MODBUS_write_single_function(MODBUS_HandleTypeDef* bus, uint8_t function , uint8_t slave_address, uint16_t starting_address , uint16_t presetdata){
+static int MODBUS_write_single_exchange(MODBUS_HandleTypeDef* bus, const uint8_t* request, uint16_t starting_address , uint16_t presetdata, uint16_t timeout){
 	uint8_t data_transfer[10];
 	uint16_t CRC16, CRC16_read;
-	//uint8_t L;
 	uint16_t add,data;
-	data_transfer[0] = slave_address;
-	data_transfer[1] = function;
-	data_transfer[2] = (uint8_t)(starting_address >> 8);
-	data_transfer[3] = (uint8_t)(starting_address & 0x00ff);
-	data_transfer[4] = (uint8_t)(presetdata >> 8);
-	data_transfer[5] = (uint8_t)(presetdata & 0x00ff);
-	CRC16 = usMBCRC16(data_transfer, 6 , 0xff , 0xff);
-	data_transfer[6] = (uint8_t)(CRC16 & 0x00ff); // CRC16 low byte first
-	data_transfer[7] = (uint8_t)(CRC16 >> 8);
 
-	bus->COM_write(data_transfer, 8, bus->response_timeout);
+	MODBUS_bus_write(bus, (uint8_t*)request, 8, timeout); // the bus does not modify the buffer
+	if (request[0] == MB_ADDRESS_BROADCAST) return 0; // no response to a broadcast
 
-	bus->COM_read(data_transfer, 8, bus->response_timeout);
-	if (data_transfer[0] != slave_address) return - 1; //fail
+	if (MODBUS_bus_read(bus, data_transfer, 8, timeout) < 3) return -1; // no response
+	if (data_transfer[0] != request[0]) return - 1; //fail
 	
-	if (data_transfer[1] != function) return data_transfer[2]; //retrun exeption code
+	if (data_transfer[1] != request[1]) return data_transfer[2]; //retrun exeption code
 	
 	add = ((uint16_t)data_transfer[2] << 8 ) | data_transfer[ 3 ];
-	if (slave_address != add) return -1;
+	if (starting_address != add) return -1;
 	
 	data = ((uint16_t)data_transfer[4] << 8 ) | data_transfer[ 5 ];
 	if (presetdata != data) return -1;
@@ -198,6 +457,39 @@ int MODBUS_write_single_function(MODBUS_HandleTypeDef* bus, uint8_t function , u
 	return 0;
 }
 /*
+* @brief : universal function for writing single data to slave
+* @param : pointer to handle that controls the communication bus( COM port)
+* @param : modbus function
+* @param : modbus slave address
+* @param : coil staring address
+* @param : preset data
+* @ret	 : success(0) or fail response
+*/
+int MODBUS_write_single_function(MODBUS_HandleTypeDef* bus, uint8_t function , uint8_t slave_address, uint16_t starting_address , uint16_t presetdata){
+	uint8_t data_transfer[8];
+	uint16_t CRC16;
+	uint8_t attempt = 0;
+	uint16_t timeout;
+	uint32_t start;
+	int ret_val;
+	data_transfer[0] = slave_address;
+	data_transfer[1] = function;
+	data_transfer[2] = (uint8_t)(starting_address >> 8);
+	data_transfer[3] = (uint8_t)(starting_address & 0x00ff);
+	data_transfer[4] = (uint8_t)(presetdata >> 8);
+	data_transfer[5] = (uint8_t)(presetdata & 0x00ff);
+	CRC16 = usMBCRC16(data_transfer, 6 , 0xff , 0xff);
+	data_transfer[6] = (uint8_t)(CRC16 & 0x00ff); // CRC16 low byte first
+	data_transfer[7] = (uint8_t)(CRC16 >> 8);
+
+	do {
+		ret_val = MODBUS_attempt_begin(bus, slave_address, attempt, &timeout, &start);
+		if (ret_val != 0) return ret_val;
+		ret_val = MODBUS_write_single_exchange(bus, data_transfer, starting_address, presetdata, timeout);
+	} while (MODBUS_attempt_end(bus, slave_address, ret_val, start, attempt++));
+	return ret_val;
+}
+/*
 * @brief : modbus Focre single coil 0x05
 * @param : pointer to handle that controls the communication bus( COM port)
 * @param : modbus slave address
@@ -222,6 +514,45 @@ int MODBUS_write_single_register(MODBUS_HandleTypeDef* bus, uint8_t slave_addres
 	return MODBUS_write_single_function(bus , MB_FUNC_WRITE_REGISTER , slave_address , starting_address , presetdata);
 }
 
+/*
+* @brief : send a preset multiple registers request and check the response, single attempt
+* @param : pointer to handle that controls the communication bus( COM port)
+* @param : first 7 bytes of the request
+* @param : register data, already in bus byte order
+* @param : number of data bytes
+* @param : CRC16 of the request
+* @param : response timeout
+* @ret	 : success(0) or fail response
+*/
+static int MODBUS_write_multiple_exchange(MODBUS_HandleTypeDef* bus, uint8_t* header, uint16_t *data, uint8_t bytes_count, uint16_t CRC16, uint16_t timeout){
+	uint8_t data_transfer[10];
+	uint16_t CRC16_read;
+	uint16_t add, data_in;
+	MODBUS_bus_write(bus, header, 7, timeout);
+	MODBUS_bus_write(bus, (uint8_t*)data, bytes_count, timeout);
+	data_transfer[0] = (uint8_t)(CRC16 & 0x00ff); // CRC16 low byte first
+	data_transfer[1] = (uint8_t)(CRC16 >> 8);
+	MODBUS_bus_write(bus, data_transfer, 2, timeout);
+	if (header[0] == MB_ADDRESS_BROADCAST) return 0; // no response to a broadcast
+
+	if (MODBUS_bus_read(bus, data_transfer, 8, timeout) < 3) return -1; // no response
+
+	if (data_transfer[0] != header[0]) return -1; //fail
+
+	if (data_transfer[1] != 0x10) return data_transfer[2]; //retrun exception code
+
+	add = ((uint16_t)data_transfer[2] << 8) | data_transfer[3];
+	if (((uint16_t)header[2] << 8 | header[3]) != add) return -1;
+
+	data_in = ((uint16_t)data_transfer[4] << 8) | data_transfer[5];
+	if (((uint16_t)header[4] << 8 | header[5]) != data_in) return -1;
+
+	CRC16_read = ((uint16_t)data_transfer[7] << 8) | data_transfer[6];
+	CRC16 = usMBCRC16(data_transfer, 6, 0xff, 0xff);
+	if (CRC16 != CRC16_read) return -1;
+
+	return 0;
+}
 /*
 * @brief : modbus preset multiple registers 0x10
 * @param : pointer to handle that controls the communication bus( COM port)
@@ -231,10 +562,12 @@ int MODBUS_write_single_register(MODBUS_HandleTypeDef* bus, uint8_t slave_addres
 * @ret	 : success(0) or fail response
 */
 int MODBUS_write_multiple_registers(MODBUS_HandleTypeDef* bus, uint8_t slave_address, uint16_t starting_address, uint16_t number_of_registers ,uint8_t bytes_count , uint16_t *data , uint8_t change_high_low_flag){
-	uint8_t data_transfer[10];
-	uint16_t CRC16, CRC16_read;
-	//uint8_t L;
-	uint16_t add, data_in;
+	uint8_t data_transfer[7];
+	uint16_t CRC16;
+	uint8_t attempt = 0;
+	uint16_t timeout;
+	uint32_t start;
+	int ret_val;
 	if (bytes_count != (number_of_registers * 2)) return -1;
 	if (change_high_low_flag) {
 		for (uint8_t i = 0; i < number_of_registers; i++) {
@@ -250,14 +583,13 @@ int MODBUS_write_multiple_registers(MODBUS_HandleTypeDef* bus, uint8_t slave_add
 	data_transfer[5] = (uint8_t)(number_of_registers & 0x00ff);
 	data_transfer[6] = bytes_count;
 	CRC16 = usMBCRC16(data_transfer, 7, 0xff, 0xff);
-	CRC16 = usMBCRC16(data, bytes_count, (uint8_t)(CRC16 >> 8), (uint8_t)(CRC16 & 0x00ff));
-	bus->COM_write(data_transfer, 7, bus->response_timeout);
-	bus->COM_write(data, bytes_count, bus->response_timeout);
-	data_transfer[0] = (uint8_t)(CRC16 & 0x00ff); // CRC16 low byte first
-	data_transfer[1] = (uint8_t)(CRC16 >> 8);
-	bus->COM_write(data_transfer, 2, bus->response_timeout);
+	CRC16 = usMBCRC16((uint8_t*)data, bytes_count, (uint8_t)(CRC16 >> 8), (uint8_t)(CRC16 & 0x00ff));
 
-	bus->COM_read(data_transfer, 8, bus->response_timeout);
+	do {
+		ret_val = MODBUS_attempt_begin(bus, slave_address, attempt, &timeout, &start);
+		if (ret_val != 0) break;
+		ret_val = MODBUS_write_multiple_exchange(bus, data_transfer, data, bytes_count, CRC16, timeout);
+	} while (MODBUS_attempt_end(bus, slave_address, ret_val, start, attempt++));
 
 	if (change_high_low_flag) {
 		for (uint8_t i = 0; i < number_of_registers; i++) {
@@ -265,21 +597,6 @@ int MODBUS_write_multiple_registers(MODBUS_HandleTypeDef* bus, uint8_t slave_add
 			 //change_high_low(data[i]);
 		}
 	}
-	if (data_transfer[0] != slave_address) return -1; //fail
-
-	if (data_transfer[1] != 0x10) return data_transfer[2]; //retrun exception code
-
-	add = ((uint16_t)data_transfer[2] << 8) | data_transfer[3];
-	if (starting_address != add) return -1;
-
-	data_in = ((uint16_t)data_transfer[4] << 8) | data_transfer[5];
-	if (number_of_registers != data_in) return -1;
-
-	CRC16 = usMBCRC16(data_transfer, 6, 0xff, 0xff);
-	CRC16_read = ((uint16_t)data_transfer[7] << 8) | data_transfer[6];
-	CRC16 = usMBCRC16(data_transfer, 6, 0xff, 0xff);
-	if (CRC16 != CRC16_read) return -1;
-
-	return 0;
+	return ret_val;
 }
 /*************************** End of file ****************************/
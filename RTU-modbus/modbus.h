@@ -16,6 +16,7 @@
 #define __MODBUS_H
 
 #include "mbcrc.h"
+#include <stddef.h>
 #include <stdint.h>
 
 #define MB_ADDRESS_BROADCAST    ( 0 )   /*! Modbus broadcast address. */
@@ -38,6 +39,35 @@
 #define MB_FUNC_OTHER_REPORT_SLAVEID          ( 17 )
 #define MB_FUNC_ERROR                         ( 128 )
 
+#define MODBUS_MAX_READ_BITS        ( 2000 ) /*! largest coil / discrete input count of one request. */
+#define MODBUS_MAX_READ_REGISTERS   ( 125 )  /*! largest register count of one request. */
+
+#define MODBUS_SLAVE_OFFLINE        ( -2 )   /*! returned while the circuit breaker of a slave is open. */
+#define MODBUS_RTO_MIN              ( 5 )    /*! lower bound of an adaptive response timeout (ms). */
+#define MODBUS_RETRY_BACKOFF        ( 4 )    /*! base of the jittered delay before a retry (ms), never more than response_timeout. */
+#define MODBUS_BACKOFF_SHIFT_MAX    ( 4 )    /*! doublings of the retry timeout and delay, later retries reuse the last one. */
+#define MODBUS_BREAKER_THRESHOLD    ( 5 )    /*! failed transactions in a row that take a slave out of rotation. */
+#define MODBUS_BREAKER_PROBE_PERIOD ( 5000 ) /*! time between probes of a slave out of rotation (ms). */
+
+/*
+ * Per slave link state, zero initialize it. The round trip time is smoothed
+ * like the TCP retransmission timer (RFC 6298) and the response timeout of
+ * the slave is derived from it, bounded by MODBUS_RTO_MIN and response_timeout.
+ */
+typedef struct
+{
+	uint16_t srtt;          // smoothed round trip time, ms << 3, 0 before the first sample
+	uint16_t rttvar;        // round trip time variation, ms << 2
+	uint16_t rto;           // response timeout of the slave (ms), 0 before the first sample
+	uint8_t failures;       // failed transactions in a row
+	uint8_t offline;        // circuit breaker open
+	uint32_t next_probe;    // tick of the next probe while offline
+} MODBUS_SlaveTypeDef;
+
+/*
+ * Zero-initialize the handle (static or = {0}) before filling it in, the
+ * members after COM_write are optional and only used when they are not 0.
+ */
 typedef struct __MODEBUS_HandleTypeDef
 {
 	uint8_t response_timeout;
@@ -45,12 +75,53 @@ typedef struct __MODEBUS_HandleTypeDef
 	uint32_t(*COM_initialize)(const char* _comport, int _baudrate, int timeout , int parity , int stop);
 	uint32_t(*COM_read)(uint8_t* pBuf, uint16_t BytesToRead , uint16_t timout); // return number of bytes read
 	uint32_t(*COM_write)(uint8_t* pBuff, uint16_t BytesToWrite,uint16_t timout); // returns number of bytes written
+
+	uint8_t retries;                // extra attempts of a failed transaction, used with slaves
+	MODBUS_SlaveTypeDef* slaves;    // MB_ADDRESS_MAX + 1 entries indexed by slave address, 0 for a fixed response_timeout
+
+	// transport with a context, used instead of COM_read / COM_write when net is set (see modbus_net.h)
+	void* net;
+	uint32_t(*NET_read)(void* net, uint8_t* pBuf, uint16_t BytesToRead, uint16_t timout);
+	uint32_t(*NET_write)(void* net, uint8_t* pBuff, uint16_t BytesToWrite, uint16_t timout);
 } MODBUS_HandleTypeDef;
 
+/*
+ * Sink of a streaming read, called once per protocol sized chunk in address
+ * order. data holds number_of_points coils / inputs (packed bits) or
+ * registers, len is its size in bytes. A non zero return stops the stream.
+ */
+typedef int(*MODBUS_SinkTypeDef)(void* context, uint16_t starting_address, uint16_t number_of_points, const uint8_t* data, size_t len);
+
+/*
+ * Pre-built read request, for poll lists that are fixed at build time.
+ * Declare them with MODBUS_READ_REQUEST so the frame and its CRC are
+ * computed by the compiler and the table can live in read-only memory :
+ *	static const MODBUS_RequestTypeDef poll_list[] = {
+ *		MODBUS_READ_REQUEST(1, MB_FUNC_READ_HOLDING_REGISTER, 0, 10),
+ *		MODBUS_READ_REQUEST(2, MB_FUNC_READ_COILS, 100, 16),
+ *	};
+ */
+typedef struct
+{
+	uint8_t frame[8];
+} MODBUS_RequestTypeDef;
+
+#define MODBUS_READ_REQUEST(slave_address, function, starting_address, number_of_points) \
+	MODBUS_READ_REQUEST_BYTES((slave_address) & 0xff, (function) & 0xff, ((starting_address) >> 8) & 0xff, \
+		(starting_address) & 0xff, ((number_of_points) >> 8) & 0xff, (number_of_points) & 0xff)
+#define MODBUS_READ_REQUEST_BYTES(b0, b1, b2, b3, b4, b5) \
+	{ { (uint8_t)(b0), (uint8_t)(b1), (uint8_t)(b2), (uint8_t)(b3), (uint8_t)(b4), (uint8_t)(b5), \
+		(uint8_t)(MB_CRC16_FRAME6(b0, b1, b2, b3, b4, b5) & 0x00ff), /* CRC16 low byte first */ \
+		(uint8_t)(MB_CRC16_FRAME6(b0, b1, b2, b3, b4, b5) >> 8) } }
+
 int MODBUS_read_coils(MODBUS_HandleTypeDef* bus, uint8_t slave_address, uint16_t starting_address , uint16_t number_of_points, uint8_t* response_data , uint8_t* response_len);
 int MODBUS_read_discrete_inputs(MODBUS_HandleTypeDef* bus, uint8_t slave_address, uint16_t starting_address, uint16_t number_of_points, uint8_t* response_data, uint8_t* response_len);
 int MODBUS_read_holding_registers(MODBUS_HandleTypeDef* bus, uint8_t slave_address, uint16_t starting_address, uint16_t number_of_points, uint16_t* response_data, uint8_t* response_len , uint8_t change_high_low_flag);
 int MODBUS_read_input_registers(MODBUS_HandleTypeDef* bus, uint8_t slave_address, uint16_t starting_address, uint16_t number_of_points, uint8_t* response_data, uint8_t* response_len , uint8_t change_high_low_flag);
+int MODBUS_read_request(MODBUS_HandleTypeDef* bus, const MODBUS_RequestTypeDef* request, uint8_t* response_data, uint8_t* response_len);
+int MODBUS_read_stream(MODBUS_HandleTypeDef* bus, uint8_t function, uint8_t slave_address, uint16_t starting_address, size_t number_of_points, uint8_t change_high_low_flag, MODBUS_SinkTypeDef sink, void* context);
+uint16_t MODBUS_read_response_bytes(const uint8_t* request);
+void MODBUS_build_read_request(MODBUS_RequestTypeDef* request, uint8_t function, uint8_t slave_address, uint16_t starting_address, uint16_t number_of_points);
 
 int MODBUS_write_single_coil(MODBUS_HandleTypeDef* bus, uint8_t slave_address, uint16_t starting_address , uint16_t presetdata);
 int MODBUS_write_single_register(MODBUS_HandleTypeDef* bus, uint8_t slave_address, uint16_t starting_address, uint16_t presetdata);
@@ -0,0 +1,399 @@
+/*************************************************************************
+ *	file : modbus_net.c
+ *	modbus RTU frames over TCP and UDP sockets (serial device servers)
+ *	Author : agent
+ *	Date : October 2026
+ *
+ *	On WIN32 the application must have called WSAStartup.
+ *
+ *************************************************************************
+ */
+#ifndef WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "modbus_net.h"
+#include "string.h"
+
+#ifdef WIN32
+#define MODBUS_NET_close_socket(s)	closesocket(s)
+#define poll	WSAPoll
+#else
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#define MODBUS_NET_close_socket(s)	close(s)
+#endif
+
+/*
+ *	@brief: monotonic time in milliseconds
+ */
+static uint32_t MODBUS_NET_tick(void) {
+#ifdef WIN32
+	return GetTickCount();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)ts.tv_sec * 1000u + (uint32_t)(ts.tv_nsec / 1000000);
+#endif
+}
+
+/*
+ *	@brief: wait until a socket has data to read
+ *	@param: socket
+ *	@param: time to wait (ms)
+ *	@return: 1 if readable, 0 on timeout or error
+ */
+static int MODBUS_NET_wait(int socket, uint32_t wait) {
+	struct pollfd pfd;
+	pfd.fd = socket;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	return poll(&pfd, 1, (int)wait) > 0 && (pfd.revents & POLLIN);
+}
+
+static int MODBUS_NET_nonblocking(int socket) {
+#ifdef WIN32
+	u_long on = 1;
+	return ioctlsocket(socket, FIONBIO, &on) == 0 ? 0 : -1;
+#else
+	int flags = fcntl(socket, F_GETFL, 0);
+	if (flags < 0) return -1;
+	return fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0 ? 0 : -1;
+#endif
+}
+
+/*
+ *	@brief: resolve an IPv4 host name or address
+ *	@param: host
+ *	@param: port
+ *	@param: SOCK_STREAM or SOCK_DGRAM
+ *	@param: resolved address
+ *	@param: length of the resolved address
+ *	@return: 0 on success
+ */
+static int MODBUS_NET_resolve(const char* host, uint16_t port, int type, struct sockaddr_storage* addr, socklen_t* addr_len) {
+	struct addrinfo hints, *res;
+	char service[6];
+	int i = 5;
+	service[5] = 0;
+	do {
+		service[--i] = (char)('0' + port % 10);
+		port /= 10;
+	} while (port);
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = type;
+	if (getaddrinfo(host, &service[i], &hints, &res) != 0) return -1;
+	memcpy(addr, res->ai_addr, res->ai_addrlen);
+	*addr_len = (socklen_t)res->ai_addrlen;
+	freeaddrinfo(res);
+	return 0;
+}
+
+/*
+*	@brief: connect to a serial device server
+*	@param: net handle to fill in
+*	@param: MODBUS_NET_TCP or MODBUS_NET_UDP
+*	@param: host name or IPv4 address
+*	@param: port
+*	@return: 0 on success
+*/
+int MODBUS_NET_open(MODBUS_NetTypeDef* net, uint8_t mode, const char* host, uint16_t port) {
+	struct sockaddr_storage addr;
+	socklen_t addr_len;
+	int type = mode == MODBUS_NET_UDP ? SOCK_DGRAM : SOCK_STREAM;
+	memset(net, 0, sizeof(MODBUS_NetTypeDef));
+	net->socket = -1;
+	net->mode = mode;
+	if (MODBUS_NET_resolve(host, port, type, &addr, &addr_len) != 0) return -1;
+	net->socket = (int)socket(AF_INET, type, 0);
+	if (net->socket < 0) return -1;
+	// a connected UDP socket only receives datagrams of its server
+	if (connect(net->socket, (struct sockaddr*)&addr, addr_len) != 0) {
+		MODBUS_NET_close(net);
+		return -1;
+	}
+	if (mode == MODBUS_NET_TCP) {
+		int on = 1;
+		setsockopt(net->socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on)); // frames are small, send them at once
+	}
+	return 0;
+}
+
+/*
+*	@brief: close the socket of a net handle, only valid after MODBUS_NET_open
+*	@return: 0 on success
+*/
+int MODBUS_NET_close(MODBUS_NetTypeDef* net) {
+	if (net->socket < 0) return -1;
+	MODBUS_NET_close_socket(net->socket);
+	net->socket = -1;
+	return 0;
+}
+
+/*
+ *	@brief: throw away everything waiting on the socket, late responses to a
+ *			timed out request would otherwise be read as the next response
+ */
+static void MODBUS_NET_drain(MODBUS_NetTypeDef* net) {
+	while (MODBUS_NET_wait(net->socket, 0)) {
+		if ((int)recv(net->socket, (char*)net->rx, MODBUS_RTU_FRAME_MAX, 0) <= 0) break;
+	}
+	net->rx_len = net->rx_used = 0;
+}
+
+/*
+ *	@brief: NET_write of modbus.c, TCP sends at once, UDP collects the request
+ *	@return: number of bytes written
+ */
+static uint32_t MODBUS_NET_write(void* context, uint8_t* pBuff, uint16_t BytesToWrite, uint16_t timout) {
+	MODBUS_NetTypeDef* net = (MODBUS_NetTypeDef*)context;
+	uint32_t sent = 0;
+	(void)timout;
+	// nothing is expected while a request is being written, so whatever is waiting is stale
+	if (net->mode == MODBUS_NET_TCP || net->tx_len == 0) MODBUS_NET_drain(net);
+	if (net->mode == MODBUS_NET_UDP) {
+		if (net->tx_len + BytesToWrite > MODBUS_RTU_FRAME_MAX) return 0;
+		memcpy(&net->tx[net->tx_len], pBuff, BytesToWrite);
+		net->tx_len += BytesToWrite;
+		return BytesToWrite;
+	}
+	while (sent < BytesToWrite) {
+		int n = (int)send(net->socket, (const char*)pBuff + sent, BytesToWrite - sent, 0);
+		if (n <= 0) break;
+		sent += (uint32_t)n;
+	}
+	return sent;
+}
+
+/*
+ *	@brief: NET_read of modbus.c, UDP sends the collected request first
+ *	@return: number of bytes actualy read
+ */
+static uint32_t MODBUS_NET_read(void* context, uint8_t* pBuf, uint16_t BytesToRead, uint16_t timout) {
+	MODBUS_NetTypeDef* net = (MODBUS_NetTypeDef*)context;
+	uint32_t start = MODBUS_NET_tick();
+	uint32_t elapsed;
+	uint16_t n = 0;
+	if (net->mode == MODBUS_NET_UDP && net->tx_len) {
+		send(net->socket, (const char*)net->tx, net->tx_len, 0);
+		net->tx_len = 0;
+	}
+	while (n < BytesToRead) {
+		int r;
+		if (net->mode == MODBUS_NET_UDP && net->rx_used < net->rx_len) {
+			uint16_t chunk = net->rx_len - net->rx_used;
+			if (chunk > BytesToRead - n) chunk = BytesToRead - n;
+			memcpy(pBuf + n, &net->rx[net->rx_used], chunk);
+			net->rx_used += chunk;
+			n += chunk;
+			continue;
+		}
+		elapsed = MODBUS_NET_tick() - start;
+		if (elapsed >= timout || !MODBUS_NET_wait(net->socket, timout - elapsed)) break;
+		if (net->mode == MODBUS_NET_UDP) {
+			r = (int)recv(net->socket, (char*)net->rx, MODBUS_RTU_FRAME_MAX, 0);
+			if (r <= 0) break;
+			net->rx_len = (uint16_t)r;
+			net->rx_used = 0;
+		}
+		else {
+			r = (int)recv(net->socket, (char*)pBuf + n, BytesToRead - n, 0);
+			if (r <= 0) break;
+			n += (uint16_t)r;
+		}
+	}
+	return n;
+}
+
+/*
+*	@brief: run the functions of modbus.c on a bus over a connected net handle
+*	@param: pointer to handle that controls the communication bus
+*	@param: net handle opened with MODBUS_NET_open
+*	@return: 0 on success
+*/
+int MODBUS_NET_attach(MODBUS_HandleTypeDef* bus, MODBUS_NetTypeDef* net) {
+	if (net->socket < 0) return -1;
+	bus->net = net;
+	bus->NET_read = MODBUS_NET_read;
+	bus->NET_write = MODBUS_NET_write;
+	return 0;
+}
+
+/*
+*	@brief: open the shared UDP socket, peers are set with MODBUS_UDP_set_peer
+*	@param: udp handle, peers, timeout, retries and on_response filled in by the user
+*	@return: 0 on success
+*/
+int MODBUS_UDP_open(MODBUS_UdpTypeDef* udp) {
+	udp->socket = -1;
+	udp->in_flight = 0;
+	for (uint16_t i = 0; i < udp->number_of_peers; i++) udp->peers[i].busy = 0;
+	udp->socket = (int)socket(AF_INET, SOCK_DGRAM, 0);
+	if (udp->socket < 0) return -1;
+	if (MODBUS_NET_nonblocking(udp->socket) != 0) {
+		MODBUS_UDP_close(udp);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+*	@brief: close the shared UDP socket, only valid after MODBUS_UDP_open
+*			(a zero-initialized handle holds socket 0)
+*	@return: 0 on success
+*/
+int MODBUS_UDP_close(MODBUS_UdpTypeDef* udp) {
+	if (udp->socket < 0) return -1;
+	MODBUS_NET_close_socket(udp->socket);
+	udp->socket = -1;
+	return 0;
+}
+
+/*
+*	@brief: set the address of a serial server port
+*	@param: udp handle
+*	@param: peer index
+*	@param: host name or IPv4 address
+*	@param: port
+*	@return: 0 on success
+*/
+int MODBUS_UDP_set_peer(MODBUS_UdpTypeDef* udp, uint16_t peer, const char* host, uint16_t port) {
+	if (peer >= udp->number_of_peers || udp->peers[peer].busy) return -1;
+	return MODBUS_NET_resolve(host, port, SOCK_DGRAM, &udp->peers[peer].addr, &udp->peers[peer].addr_len);
+}
+
+/*
+*	@brief: send a request to a peer without waiting, the response comes through MODBUS_UDP_poll
+*	@param: udp handle
+*	@param: peer index
+*	@param: request frame
+*	@return: 0 on success, -1 if the peer still has a request in flight
+*/
+int MODBUS_UDP_send_request(MODBUS_UdpTypeDef* udp, uint16_t peer, const MODBUS_RequestTypeDef* request) {
+	MODBUS_UdpPeerTypeDef* p;
+	if (peer >= udp->number_of_peers) return -1;
+	p = &udp->peers[peer];
+	if (p->busy) return -1;
+	memcpy(p->request, request->frame, 8);
+	if (sendto(udp->socket, (const char*)p->request, 8, 0, (struct sockaddr*)&p->addr, p->addr_len) != 8) return -1;
+	p->busy = 1;
+	p->retries_left = udp->retries;
+	p->sent_tick = MODBUS_NET_tick();
+	udp->in_flight++;
+	return 0;
+}
+
+/*
+*	@brief: build and send a read request to a peer without waiting
+*	@param: udp handle
+*	@param: peer index
+*	@param: modbus read function
+*	@param: modbus slave address
+*	@param: coil staring address
+*	@param: number of coils to read
+*	@return: 0 on success, -1 if the peer still has a request in flight
+*/
+int MODBUS_UDP_send_read(MODBUS_UdpTypeDef* udp, uint16_t peer, uint8_t function, uint8_t slave_address, uint16_t starting_address, uint16_t number_of_points) {
+	MODBUS_RequestTypeDef request;
+	MODBUS_build_read_request(&request, function, slave_address, starting_address, number_of_points);
+	return MODBUS_UDP_send_request(udp, peer, &request);
+}
+
+static int MODBUS_UDP_same_address(const MODBUS_UdpPeerTypeDef* p, const struct sockaddr_storage* from) {
+	const struct sockaddr_in* a = (const struct sockaddr_in*)&p->addr;
+	const struct sockaddr_in* b = (const struct sockaddr_in*)from;
+	return b->sin_family == AF_INET && a->sin_port == b->sin_port && a->sin_addr.s_addr == b->sin_addr.s_addr;
+}
+
+/*
+ *	@brief: match a datagram to the request in flight of its peer and report it
+ *	@return: 1 if the datagram completed a request
+ */
+static int MODBUS_UDP_receive(MODBUS_UdpTypeDef* udp, const uint8_t* frame, int len, const struct sockaddr_storage* from) {
+	MODBUS_UdpPeerTypeDef* p;
+	uint16_t CRC16;
+	uint16_t i;
+	for (i = 0; i < udp->number_of_peers; i++) {
+		if (udp->peers[i].busy && MODBUS_UDP_same_address(&udp->peers[i], from)) break;
+	}
+	if (i == udp->number_of_peers || len < 5) return 0; // stray or late datagram
+	p = &udp->peers[i];
+	CRC16 = usMBCRC16((uint8_t*)frame, (uint16_t)(len - 2), 0xff, 0xff);
+	if (CRC16 != (((uint16_t)frame[len - 1] << 8) | frame[len - 2])) return 0;
+	if (frame[0] != p->request[0]) return 0;
+	p->busy = 0;
+	udp->in_flight--;
+	if (frame[1] == (p->request[1] | MB_FUNC_ERROR)) {
+		if (udp->on_response) udp->on_response(udp, i, frame[2], 0, 0); // exception code
+	}
+	else if (frame[1] != p->request[1]) {
+		if (udp->on_response) udp->on_response(udp, i, -1, 0, 0);
+	}
+	else if (frame[1] == MB_FUNC_WRITE_SINGLE_COIL || frame[1] == MB_FUNC_WRITE_REGISTER) {
+		int echo = len == 8 && memcmp(frame, p->request, 8) == 0;
+		if (udp->on_response) udp->on_response(udp, i, echo ? 0 : -1, &frame[2], 4);
+	}
+	else {
+		int ok = len == frame[2] + 5 && frame[2] == MODBUS_read_response_bytes(p->request);
+		if (udp->on_response) udp->on_response(udp, i, ok ? 0 : -1, &frame[3], ok ? frame[2] : 0);
+	}
+	return 1;
+}
+
+/*
+*	@brief: receive responses, resend or time out requests in flight
+*	@param: udp handle
+*	@param: longest time to wait (ms), returns earlier when nothing is left in flight
+*	@return: number of completed requests, timeouts included
+*/
+int MODBUS_UDP_poll(MODBUS_UdpTypeDef* udp, uint16_t wait) {
+	uint8_t frame[MODBUS_RTU_FRAME_MAX];
+	struct sockaddr_storage from;
+	socklen_t from_len;
+	uint32_t start = MODBUS_NET_tick();
+	uint32_t now, left, age;
+	int completed = 0;
+	int len;
+	do {
+		now = MODBUS_NET_tick();
+		left = now - start < wait ? wait - (now - start) : 0;
+		// sleep no longer than the first request that runs out of time
+		for (uint16_t i = 0; i < udp->number_of_peers; i++) {
+			if (!udp->peers[i].busy) continue;
+			age = now - udp->peers[i].sent_tick;
+			if (age >= udp->timeout) left = 0;
+			else if (udp->timeout - age < left) left = udp->timeout - age;
+		}
+		if (udp->in_flight && MODBUS_NET_wait(udp->socket, left)) {
+			for (;;) {
+				from_len = sizeof(from);
+				len = (int)recvfrom(udp->socket, (char*)frame, sizeof(frame), 0, (struct sockaddr*)&from, &from_len);
+				if (len < 0) break;
+				completed += MODBUS_UDP_receive(udp, frame, len, &from);
+			}
+		}
+		now = MODBUS_NET_tick();
+		for (uint16_t i = 0; i < udp->number_of_peers; i++) {
+			MODBUS_UdpPeerTypeDef* p = &udp->peers[i];
+			if (!p->busy || now - p->sent_tick < udp->timeout) continue;
+			if (p->retries_left) {
+				p->retries_left--;
+				p->sent_tick = now;
+				sendto(udp->socket, (const char*)p->request, 8, 0, (struct sockaddr*)&p->addr, p->addr_len);
+				continue;
+			}
+			p->busy = 0;
+			udp->in_flight--;
+			completed++;
+			if (udp->on_response) udp->on_response(udp, i, -1, 0, 0);
+		}
+	} while (udp->in_flight && MODBUS_NET_tick() - start < wait);
+	return completed;
+}
+/*************************** End of file ****************************/
@@ -0,0 +1,85 @@
+/*************************************************************************
+ *	file : modbus_net.h
+ *	modbus RTU frames over TCP and UDP sockets (serial device servers)
+ *	Author : agent
+ *	Date : October 2026
+ *
+ *	RTU-over-TCP / RTU-over-UDP : the frames, CRC included, are carried as
+ *	they are on the serial line. MODBUS_NET_attach lets every function of
+ *	modbus.c run over such a socket. MODBUS_UDP_xxx keeps many requests in
+ *	flight on a single UDP socket, one per serial server port.
+ *	Needs BSD sockets (POSIX, lwIP socket API) or winsock on WIN32.
+ *
+ *************************************************************************
+ */
+
+#ifndef __MODBUS_NET_H
+#define __MODBUS_NET_H
+
+#include "modbus.h"
+#include <stdint.h>
+#ifdef WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#endif
+
+#define MODBUS_NET_TCP          ( 0 )
+#define MODBUS_NET_UDP          ( 1 )
+#define MODBUS_RTU_FRAME_MAX    ( 256 )
+
+typedef struct __MODBUS_NetTypeDef
+{
+	int socket;
+	uint8_t mode;                           // MODBUS_NET_TCP or MODBUS_NET_UDP
+	uint8_t tx[MODBUS_RTU_FRAME_MAX];       // UDP : a request is sent as one datagram
+	uint16_t tx_len;
+	uint8_t rx[MODBUS_RTU_FRAME_MAX];       // UDP : datagram being read
+	uint16_t rx_len;
+	uint16_t rx_used;
+} MODBUS_NetTypeDef;
+
+int MODBUS_NET_open(MODBUS_NetTypeDef* net, uint8_t mode, const char* host, uint16_t port);
+int MODBUS_NET_close(MODBUS_NetTypeDef* net);  // only after MODBUS_NET_open, even if it failed
+int MODBUS_NET_attach(MODBUS_HandleTypeDef* bus, MODBUS_NetTypeDef* net);
+
+/*
+ * One serial server port reached over the shared UDP socket. A peer has at
+ * most one request in flight, RTU frames carry no transaction id and the
+ * response is matched by its source address.
+ */
+typedef struct
+{
+	struct sockaddr_storage addr;
+	socklen_t addr_len;
+	uint8_t busy;
+	uint8_t retries_left;
+	uint8_t request[8];
+	uint32_t sent_tick;
+	void* user_data;
+} MODBUS_UdpPeerTypeDef;
+
+typedef struct __MODBUS_UdpTypeDef
+{
+	int socket;
+	MODBUS_UdpPeerTypeDef* peers;   // provided by user
+	uint16_t number_of_peers;
+	uint16_t timeout;               // response timeout (ms)
+	uint8_t retries;                // resends of a request without response
+	uint16_t in_flight;
+
+	// result : 0, exception code, or -1 on timeout. data holds the bytes after the byte count.
+	void(*on_response)(struct __MODBUS_UdpTypeDef* udp, uint16_t peer, int result, const uint8_t* data, uint8_t len);
+	void* user_data;
+} MODBUS_UdpTypeDef;
+
+int MODBUS_UDP_open(MODBUS_UdpTypeDef* udp);
+int MODBUS_UDP_close(MODBUS_UdpTypeDef* udp);   // only after MODBUS_UDP_open, even if it failed
+int MODBUS_UDP_set_peer(MODBUS_UdpTypeDef* udp, uint16_t peer, const char* host, uint16_t port);
+int MODBUS_UDP_send_request(MODBUS_UdpTypeDef* udp, uint16_t peer, const MODBUS_RequestTypeDef* request);
+int MODBUS_UDP_send_read(MODBUS_UdpTypeDef* udp, uint16_t peer, uint8_t function, uint8_t slave_address, uint16_t starting_address, uint16_t number_of_points);
+int MODBUS_UDP_poll(MODBUS_UdpTypeDef* udp, uint16_t wait);
+
+#endif
+/*************************** End of file ****************************/
@@ -44,6 +44,17 @@ extern int read_ethernet(uint8_t *buf, uint32_t numBytestoRead);
 */
 extern int Deinitialize_ethernet();
 
+#ifdef TCP_MODBUS_CAPTURE
+/*
+*	@brief:	record all TCP traffic through Capture-modbus/mbcapture.c,
+*			the wrappers call the functions above.
+*/
+int MBCAP_write_ethernet(uint8_t *buff, uint32_t numBytestoWrite);
+int MBCAP_read_ethernet(uint8_t *buf, uint32_t numBytestoRead);
+#define write_ethernet	MBCAP_write_ethernet
+#define read_ethernet	MBCAP_read_ethernet
+#endif
+
 /*
 *	@brief: change the MSB and LSB of a 16-bit data
 *	@param: input 16-bit data
@@ -71,6 +82,32 @@ int TCP_MODBUS_init(uint8_t ip_1, uint8_t ip_2, uint8_t ip_3, uint8_t ip_4) {
 	return -1;
 }
 /*
+*@brief : fill in a 12 bytes read request with the next transaction id
+* @param : request buffer, 12 bytes
+* @param : modbus read function
+* @param : staring address
+* @param : number of points to read
+* @ret	 : transaction id of the request
+*/
+static uint16_t TCP_MODBUS_build_read_request(uint8_t* frame, uint8_t function, uint16_t starting_address, uint16_t number_of_points) {
+	trans_id++;
+	frame[0] = (uint8_t)(trans_id >> 8);
+	frame[1] = (uint8_t)(trans_id & 0x00ff);//transaction id
+	frame[2] = 0;// modbus
+	frame[3] = 0;//modbus
+	frame[4] = 0;//number of points
+	frame[5] = 0x06; // send pakcegs are always 12bytes and this section is always 6
+	frame[6] = 5; // unit identifier
+	frame[7] = function;
+
+	frame[8] = (uint8_t)(starting_address >> 8);
+	frame[9] = (uint8_t)(starting_address & 0x00ff);
+
+	frame[10] = (uint8_t)(number_of_points >> 8);
+	frame[11] = (uint8_t)(number_of_points & 0x00ff);
+	return trans_id;
+}
+/*
 *@brief : Universal function for reading the input from the slave
 * @param : modbus read function
 * @param : coil staring address
@@ -84,22 +121,7 @@ int TCP_MODBUS_read_function(uint8_t function, uint16_t starting_address, uint16
 	uint8_t L;
 	uint16_t temp;
 	*response_len = 0;
-	trans_id++;
-	data_transfer[0] = (uint8_t)(trans_id >> 8);
-	data_transfer[1] = (uint8_t)(trans_id & 0x00ff);//transaction id
-	data_transfer[2] = 0;// modbus
-	data_transfer[3] = 0;//modbus
-	data_transfer[4] = 0;//number of points
-	data_transfer[5] = 0x06; // send pakcegs are always 12bytes and this section is always 6
-	data_transfer[6] = 5; // unit identifier
-	data_transfer[7] = function;
-
-	data_transfer[8] = (uint8_t)(starting_address >> 8);
-	data_transfer[9] = (uint8_t)(starting_address & 0x00ff);
-
-	data_transfer[10] = (uint8_t)(number_of_points >> 8);
-	data_transfer[11] = (uint8_t)(number_of_points & 0x00ff);
-
+	TCP_MODBUS_build_read_request(data_transfer, function, starting_address, number_of_points);
 	write_ethernet(data_transfer, 12);
 	do{
 	L = read_ethernet(data_transfer, 9);
@@ -195,6 +217,90 @@ int TCP_MODBUS_read_input_registers(uint16_t starting_address, uint16_t number_o
 	*response_len = L;
 	return ret_val;
 }
+/*
+* @brief : read an address range of any size into a sink, keeping up to
+*			TCP_MODBUS_PIPELINE_DEPTH requests in flight
+* @param : modbus read function, 0x01 to 0x04
+* @param : first address of the range
+* @param : number of coils / registers, the range may not go past address 65535
+* @param : change high and low bytes of 16-bit data
+* @param : called with every chunk, see TCP_MODBUS_SinkTypeDef
+* @param : passed to the sink
+* @ret	 : success(0), exception code of the slave, -1 on failure, or the non zero return of the sink
+*/
+int TCP_MODBUS_read_stream(uint8_t function, uint16_t starting_address, size_t number_of_points, uint8_t change_high_low_flag, TCP_MODBUS_SinkTypeDef sink, void* context) {
+	uint8_t data_transfer[12];
+	uint16_t chunk_data[TCP_MODBUS_MAX_READ_REGISTERS + 3]; // 16-bit aligned response buffer
+	struct {
+		uint16_t trans_id;
+		uint16_t address;
+		uint16_t points;
+	} pending[TCP_MODBUS_PIPELINE_DEPTH];
+	uint8_t head = 0, in_flight = 0, slot;
+	uint32_t address = starting_address;
+	size_t max_points, points, expected;
+	uint16_t temp;
+	uint8_t L;
+	int ret_val;
+	switch (function) {
+	case MB_FUNC_READ_COILS:
+	case MB_FUNC_READ_DISCRETE_INPUTS:
+		max_points = TCP_MODBUS_MAX_READ_BITS;
+		break;
+	case MB_FUNC_READ_HOLDING_REGISTER:
+	case MB_FUNC_READ_INPUT_REGISTER:
+		max_points = TCP_MODBUS_MAX_READ_REGISTERS;
+		break;
+	default:
+		return -1;
+	}
+	if (number_of_points == 0 || number_of_points > 0x10000u - starting_address) return -1; // crosses address 65535
+	while (number_of_points || in_flight) {
+		while (number_of_points && in_flight < TCP_MODBUS_PIPELINE_DEPTH) {
+			points = number_of_points < max_points ? number_of_points : max_points;
+			slot = (head + in_flight) % TCP_MODBUS_PIPELINE_DEPTH;
+			pending[slot].trans_id = TCP_MODBUS_build_read_request(data_transfer, function, (uint16_t)address, (uint16_t)points);
+			if (write_ethernet(data_transfer, 12) != 12) return -1;
+			pending[slot].address = (uint16_t)address;
+			pending[slot].points = (uint16_t)points;
+			in_flight++;
+			address += points;
+			number_of_points -= points;
+		}
+		if (read_ethernet(data_transfer, 9) != 9) return -1;
+		temp = (uint16_t)data_transfer[1] | (uint16_t)data_transfer[0] << 8;
+		if (data_transfer[7] & MB_FUNC_ERROR) { // exception response, no data follows
+			if ((int16_t)(temp - pending[head].trans_id) < 0) continue; // left over from an earlier call
+			if (temp != pending[head].trans_id || data_transfer[7] != (function | MB_FUNC_ERROR)) return -1;
+			ret_val = data_transfer[8] ? data_transfer[8] : -1; // exception code, like MODBUS_read_stream
+			while (--in_flight) { // read the responses to the requests behind it, the next call must not get them
+				if (read_ethernet(data_transfer, 9) != 9) break;
+				if (data_transfer[7] & MB_FUNC_ERROR) continue;
+				L = data_transfer[8];
+				if (read_ethernet((uint8_t*)chunk_data, L) != L) break;
+			}
+			return ret_val;
+		}
+		L = data_transfer[8];
+		if (read_ethernet((uint8_t*)chunk_data, L) != L) return -1;
+		if ((int16_t)(temp - pending[head].trans_id) < 0) continue; // left over from an earlier call
+		if (temp != pending[head].trans_id) return -1;
+		if (data_transfer[7] != function) return -1;
+		points = pending[head].points;
+		expected = max_points == TCP_MODBUS_MAX_READ_REGISTERS ? points * 2 : (points + 7) / 8;
+		if (L != expected) return -1;
+		if (max_points == TCP_MODBUS_MAX_READ_REGISTERS && change_high_low_flag) {
+			for (int i = 0; i < (L / 2); i++) {
+				chunk_data[i] = change_high_low(chunk_data[i]);
+			}
+		}
+		ret_val = sink(context, pending[head].address, (uint16_t)points, (const uint8_t*)chunk_data, L);
+		if (ret_val != 0) return ret_val;
+		head = (head + 1) % TCP_MODBUS_PIPELINE_DEPTH;
+		in_flight--;
+	}
+	return 0;
+}
 
 /*
 * @brief : universal function for writing single data to slave
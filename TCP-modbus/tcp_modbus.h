@@ -1,5 +1,6 @@
 #ifndef __TCP_MODEBUS__
 #define __TCP_MODEBUS__
+#include <stddef.h>
 #include <stdint.h>
 #include "application.h"
 
@@ -23,6 +24,19 @@
 #define MB_FUNC_OTHER_REPORT_SLAVEID          ( 17 )
 #define MB_FUNC_ERROR                         ( 128 )
 
+#define TCP_MODBUS_MAX_READ_BITS        ( 2000 ) /*! largest coil / discrete input count of one request. */
+#define TCP_MODBUS_MAX_READ_REGISTERS   ( 125 )  /*! largest register count of one request. */
+#ifndef TCP_MODBUS_PIPELINE_DEPTH
+#define TCP_MODBUS_PIPELINE_DEPTH       ( 4 )    /*! requests in flight during a streaming read. */
+#endif
+
+/*
+ * Sink of a streaming read, called once per protocol sized chunk in address
+ * order. data holds number_of_points coils / inputs (packed bits) or
+ * registers, len is its size in bytes. A non zero return stops the stream.
+ */
+typedef int(*TCP_MODBUS_SinkTypeDef)(void* context, uint16_t starting_address, uint16_t number_of_points, const uint8_t* data, size_t len);
+
 extern uint8_t tcp_modbus_ip[4];
 typedef struct {
 	uint8_t IP[4];
@@ -35,6 +49,7 @@ int TCP_MODBUS_read_coils(uint16_t starting_address, uint16_t number_of_points,
 int TCP_MODBUS_read_discrete_inputs(uint16_t starting_address, uint16_t number_of_points, uint8_t* response_data, uint8_t* response_len);
 int TCP_MODBUS_read_holding_registers(uint16_t starting_address, uint16_t number_of_points, uint16_t* response_data, uint8_t* response_len, uint8_t change_high_low_flag);
 int TCP_MODBUS_read_input_registers(uint16_t starting_address, uint16_t number_of_points, uint8_t* response_data, uint8_t* response_len, uint8_t change_high_low_flag);
+int TCP_MODBUS_read_stream(uint8_t function, uint16_t starting_address, size_t number_of_points, uint8_t change_high_low_flag, TCP_MODBUS_SinkTypeDef sink, void* context);
 
 int TCP_MODBUS_write_single_coil(uint16_t starting_address, uint16_t presetdata);
 int TCP_MODBUS_write_single_register(uint16_t starting_address, uint16_t presetdata);